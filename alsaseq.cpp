@@ -0,0 +1,115 @@
+#include "electone.h"
+
+#ifdef ELECTONE_WITH_ALSA_SEQ
+#include <alsa/asoundlib.h>
+
+struct AlsaSeqState {
+    snd_seq_t* seq = nullptr;
+    snd_midi_event_t* coder = nullptr;
+    int port = -1;
+    int queue = -1;
+};
+
+// Busca un puerto de escritura cuyo nombre de cliente o puerto contenga 'dest'
+static bool findDestination(snd_seq_t* seq, const std::string& dest, int& client, int& port) {
+    snd_seq_client_info_t* cinfo;
+    snd_seq_port_info_t* pinfo;
+    snd_seq_client_info_alloca(&cinfo);
+    snd_seq_port_info_alloca(&pinfo);
+
+    snd_seq_client_info_set_client(cinfo, -1);
+    while (snd_seq_query_next_client(seq, cinfo) >= 0) {
+        int c = snd_seq_client_info_get_client(cinfo);
+        std::string cname = snd_seq_client_info_get_name(cinfo);
+        snd_seq_port_info_set_client(pinfo, c);
+        snd_seq_port_info_set_port(pinfo, -1);
+        while (snd_seq_query_next_port(seq, pinfo) >= 0) {
+            unsigned caps = snd_seq_port_info_get_capability(pinfo);
+            if ((caps & (SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE)) != (SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE)) continue;
+            std::string pname = snd_seq_port_info_get_name(pinfo);
+            if (cname.find(dest) != std::string::npos || pname.find(dest) != std::string::npos) {
+                client = c;
+                port = snd_seq_port_info_get_port(pinfo);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+AlsaSeqSink::AlsaSeqSink(const std::string& dest) {
+    AlsaSeqState* st = new AlsaSeqState();
+    if (snd_seq_open(&st->seq, "default", SND_SEQ_OPEN_OUTPUT, 0) < 0) {
+        std::cerr << "Error ALSA seq: no se pudo abrir el secuenciador" << std::endl;
+        delete st;
+        return;
+    }
+    snd_seq_set_client_name(st->seq, "Electone Core");
+    st->port = snd_seq_create_simple_port(st->seq, "Electone Lookahead",
+                                          SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ,
+                                          SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+    st->queue = snd_seq_alloc_named_queue(st->seq, "Electone Lookahead");
+    if (st->port < 0 || st->queue < 0 || snd_midi_event_new(256, &st->coder) < 0) {
+        std::cerr << "Error ALSA seq: no se pudo crear puerto/cola" << std::endl;
+        snd_seq_close(st->seq);
+        delete st;
+        return;
+    }
+    snd_seq_start_queue(st->seq, st->queue, nullptr);
+    snd_seq_drain_output(st->seq);
+
+    int client, port;
+    if (findDestination(st->seq, dest, client, port)) {
+        snd_seq_connect_to(st->seq, st->port, client, port);
+        std::cout << "Output (lookahead): ALSA seq " << client << ":" << port << std::endl;
+    } else {
+        std::cout << "Output (lookahead): '" << dest << "' no encontrado, puerto " << snd_seq_client_id(st->seq)
+                  << ":" << st->port << " libre para aconnect" << std::endl;
+    }
+    state = st;
+}
+
+AlsaSeqSink::~AlsaSeqSink() {
+    if (!state) return;
+    snd_seq_stop_queue(state->seq, state->queue, nullptr);
+    snd_seq_drain_output(state->seq);
+    snd_seq_free_queue(state->seq, state->queue);
+    snd_midi_event_free(state->coder);
+    snd_seq_close(state->seq);
+    delete state;
+}
+
+// Convierte el stream (puede venir con running status) en eventos con tiempo relativo a la cola
+void AlsaSeqSink::send(const unsigned char* data, size_t size, long long delayNs) {
+    if (!state) return;
+    snd_seq_real_time_t when;
+    when.tv_sec = (unsigned int)(delayNs / 1000000000LL);
+    when.tv_nsec = (unsigned int)(delayNs % 1000000000LL);
+
+    size_t offset = 0;
+    while (offset < size) {
+        snd_seq_event_t ev;
+        snd_seq_ev_clear(&ev);
+        long used = snd_midi_event_encode(state->coder, data + offset, (long)(size - offset), &ev);
+        if (used <= 0) break;
+        offset += used;
+        if (ev.type == SND_SEQ_EVENT_NONE) continue;
+
+        snd_seq_ev_set_source(&ev, state->port);
+        snd_seq_ev_set_subs(&ev);
+        snd_seq_ev_schedule_real(&ev, state->queue, 1, &when);
+        snd_seq_event_output(state->seq, &ev);
+    }
+    snd_seq_drain_output(state->seq);
+}
+
+void AlsaSeqSink::cancelScheduled() {
+    if (!state) return;
+    snd_seq_remove_events_t* rm;
+    snd_seq_remove_events_alloca(&rm);
+    snd_seq_remove_events_set_queue(rm, state->queue);
+    snd_seq_remove_events_set_condition(rm, SND_SEQ_REMOVE_OUTPUT | SND_SEQ_REMOVE_IGNORE_OFF);
+    snd_seq_remove_events(state->seq, rm);
+    snd_midi_event_reset_encode(state->coder);
+}
+#endif
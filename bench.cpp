@@ -0,0 +1,401 @@
+#include "electone.h"
+#include <fstream>
+#include <chrono>
+#include <ctime>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+
+// --- BENCH ---
+// electone_core bench [opciones]: mide el camino caliente con cargas peores que las de un
+// show (32 pasos con 8 pistas llenas, acordes de 10 notas, flood de CCs del nanoKONTROL
+// contra un clock de 300 BPM). El destino es un MidiSink que solo cuenta: se mide nuestro
+// código, no ALSA ni FluidSynth.
+
+#ifdef ELECTONE_COUNT_ALLOCS
+static const bool ALLOCS_COUNTED = true;
+#else
+static const bool ALLOCS_COUNTED = false;
+#endif
+
+class CountingSink : public MidiSink {
+public:
+    std::atomic<unsigned long> sends{0};
+    std::atomic<unsigned long> bytes{0};
+    void send(const unsigned char* data, size_t size, long long delayNs = 0) override {
+        sends.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    bool acceptsStream() const override { return MIDI_BATCHED; }
+};
+
+struct BenchOptions {
+    long ticks = 24 * 4 * 100;  // 100 compases de 4/4
+    long noteOps = 100000;
+    double seconds = 5;         // Carga mezclada a tiempo real
+    std::string out = "bench_results.jsonl";
+    std::string tag;            // Commit o lo que sirva para comparar (make bench pone el hash)
+};
+
+static void printUsage() {
+    std::cout << "Uso: electone_core bench [opciones]\n"
+                 "  --ticks N         ticks de clock por carga de onClock (9600)\n"
+                 "  --note-ops N      llamadas a onNoteInput (100000)\n"
+                 "  --seconds S       duración de la carga mezclada a 300 BPM (5)\n"
+                 "  --out archivo     resultados, una línea JSON por medición (bench_results.jsonl, se agrega)\n"
+                 "  --tag texto       identifica la corrida (commit)" << std::endl;
+}
+
+// Muestras por operación: reservadas antes de medir, así guardarlas no aloca
+class Samples {
+public:
+    Samples(const char* name, size_t capacity) : name(name) { ns.reserve(capacity); }
+    void add(long long v, unsigned long allocs = 0) {
+        if (ns.size() < ns.capacity()) ns.push_back(v);
+        totalAllocs += allocs;
+        if (allocs > maxAllocs) maxAllocs = allocs;
+    }
+
+    const char* name;
+    std::vector<long long> ns;
+    unsigned long totalAllocs = 0;
+    unsigned long maxAllocs = 0;
+    bool countAllocs = ALLOCS_COUNTED; // En las cargas con varios hilos el contador global no sirve
+};
+
+struct BenchContext {
+    const BenchOptions& opt;
+    std::ofstream& out;
+    std::string host;
+    long long stamp;
+};
+
+static void report(BenchContext& ctx, Samples& s) {
+    if (s.ns.empty()) return;
+    std::vector<long long> sorted = s.ns;
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0;
+    for (long long v : sorted) sum += v;
+    size_t n = sorted.size();
+    double mean = sum / n;
+    long long p50 = sorted[n / 2];
+    long long p99 = sorted[std::min(n - 1, n * 99 / 100)];
+    long long max = sorted[n - 1];
+
+    char line[512];
+    snprintf(line, sizeof(line), "%-44s %9zu ops %9.0f ns/op  p50 %7lld  p99 %8lld  máx %9lld ns", s.name, n, mean, p50, p99, max);
+    std::cout << line;
+    if (s.countAllocs) std::cout << "  alloc/op " << (double)s.totalAllocs / n << " (máx " << s.maxAllocs << ")";
+    std::cout << std::endl;
+
+    std::string allocs = "null", maxAllocs = "null";
+    if (s.countAllocs) {
+        snprintf(line, sizeof(line), "%.4f", (double)s.totalAllocs / n);
+        allocs = line;
+        maxAllocs = std::to_string(s.maxAllocs);
+    }
+    snprintf(line, sizeof(line),
+             "{\"time\":%lld,\"host\":\"%s\",\"tag\":\"%s\",\"batched\":%s,\"bench\":\"%s\",\"ops\":%zu,"
+             "\"ns_per_op\":%.1f,\"p50_ns\":%lld,\"p99_ns\":%lld,\"max_ns\":%lld,\"allocs_per_op\":%s,\"max_allocs\":%s}",
+             ctx.stamp, ctx.host.c_str(), ctx.opt.tag.c_str(), MIDI_BATCHED ? "true" : "false", s.name, n, mean, p50, p99, max,
+             allocs.c_str(), maxAllocs.c_str());
+    ctx.out << line << "\n";
+}
+
+// --- CARGAS SINTÉTICAS ---
+// Estilo 0: 32 pasos, 8 pistas de batería en todos los pasos, swing y humanize, y tres
+// partes de acompañamiento (acorde con voice-leading, arpegio y bajo por grados).
+// Estilo 1: el mismo acompañamiento con la batería muda, para medir solo el acomp.
+static void buildStyles(std::map<int, DrumStyle>& drums, std::map<int, AcompStyle>& acomps) {
+    const int STEPS = 32;
+    static const int DRUM_NOTES[] = { 36, 38, 42, 46, 49, 51, 45, 39 };
+
+    DrumStyle dense;
+    dense.steps = STEPS;
+    dense.swing = 2;
+    dense.humanize = 8;
+    DrumPattern full;
+    for (int n : DRUM_NOTES) {
+        std::vector<int> track(STEPS);
+        for (int s = 0; s < STEPS; s++) track[s] = (s % 4 == 0) ? 120 : 1;
+        full.tracks[n] = track;
+    }
+    dense.variations[0] = full;
+    drums[0] = dense;
+
+    DrumStyle quiet = dense;
+    quiet.variations[0].tracks.clear();
+    quiet.variations[0].tracks[36] = std::vector<int>(STEPS, 0);
+    drums[1] = quiet;
+
+    AcompPattern ap;
+    AcompPart chord;
+    chord.mode = "chord";
+    chord.steps = STEPS;
+    chord.voiceLead = true;
+    chord.pattern = std::vector<int>(STEPS, 1);
+    ap.parts.push_back(chord);
+
+    AcompPart arp;
+    arp.channel = 5;
+    arp.mode = "arp-loop";
+    arp.steps = STEPS;
+    for (int s = 0; s < STEPS; s++) arp.pattern.push_back(1 + s % 10);
+    ap.parts.push_back(arp);
+
+    AcompPart bass;
+    bass.channel = 6;
+    bass.mode = "degree";
+    bass.octave = 2;
+    bass.steps = 16;
+    bass.pattern = { 1, 0, 3, 0, 5, 0, 7, 0, 8, 0, 5, 0, 3, 0, 1, 9 };
+    ap.parts.push_back(bass);
+
+    AcompStyle as;
+    as.patterns[0] = ap;
+    acomps[0] = as;
+    acomps[1] = as;
+}
+
+// Acordes de 10 notas (dos manos), uno por compás
+static const int CHORDS[][10] = {
+    { 36, 43, 48, 52, 55, 60, 64, 67, 71, 74 }, // Cmaj9
+    { 33, 40, 45, 48, 52, 57, 60, 64, 67, 71 }, // Am9
+    { 38, 45, 50, 53, 57, 62, 65, 69, 72, 76 }, // Dm9
+    { 31, 38, 43, 47, 50, 53, 57, 59, 62, 65 }, // G13
+};
+static const int N_CHORDS = sizeof(CHORDS) / sizeof(CHORDS[0]);
+
+static void changeChord(Sequencer& s, int from, int to) {
+    if (from >= 0) for (int n : CHORDS[from]) s.onNoteInput(n, false);
+    for (int n : CHORDS[to]) s.onNoteInput(n, true);
+}
+
+// onClock tick a tick; los ticks de paso (cada 6) se informan aparte
+static void benchClock(BenchContext& ctx, int style, const char* allName, const char* stepName) {
+    CountingSink sink;
+    Sequencer s(&sink);
+    std::map<int, DrumStyle> drums;
+    std::map<int, AcompStyle> acomps;
+    buildStyles(drums, acomps);
+    s.publishDatabases(compileDrumStyles(drums), compileAcompStyles(acomps));
+    s.setStyle(style);
+    s.setAcompPattern(0);
+
+    const long BAR = 32 * 6;
+    long ticks = ctx.opt.ticks;
+    Samples all(allName, ticks), step(stepName, ticks / 6 + 1);
+    int chordIdx = 0;
+    changeChord(s, -1, chordIdx);
+    s.onStart();
+    for (long t = 0; t < BAR; t++) s.onClock(); // Calentamiento: voicings y cachés
+
+    for (long t = 0; t < ticks; t++) {
+        if (t % BAR == 0) { // Cambio de acorde en cada compás: fuerza rearmar los voicings
+            int next = (chordIdx + 1) % N_CHORDS;
+            changeChord(s, chordIdx, next);
+            chordIdx = next;
+        }
+        unsigned long a0 = heapAllocCount();
+        long long t0 = monoNowNs();
+        s.onClock();
+        long long dt = monoNowNs() - t0;
+        unsigned long allocs = heapAllocCount() - a0;
+        all.add(dt, allocs);
+        if (t % 6 == 0) step.add(dt, allocs);
+    }
+    s.onStop();
+    report(ctx, all);
+    report(ctx, step);
+}
+
+// onNoteInput sonando (solo encola: el clock drena) y parado (drena en el momento)
+static void benchNoteInput(BenchContext& ctx) {
+    CountingSink sink;
+    std::map<int, DrumStyle> drums;
+    std::map<int, AcompStyle> acomps;
+    buildStyles(drums, acomps);
+    std::vector<CompiledDrumStyle> cd = compileDrumStyles(drums);
+    std::vector<CompiledAcompStyle> ca = compileAcompStyles(acomps);
+
+    for (int playing = 1; playing >= 0; playing--) {
+        Sequencer s(&sink);
+        s.publishDatabases(cd, ca);
+        if (playing) s.onStart();
+        Samples ops(playing ? "onNoteInput (sonando, encola)" : "onNoteInput (parado, drena y reconoce)", ctx.opt.noteOps);
+        for (long i = 0; i < ctx.opt.noteOps; i++) {
+            const int* chord = CHORDS[(i / 20) % N_CHORDS];
+            int note = chord[i % 10];
+            bool on = (i / 10) % 2 == 0;
+            unsigned long a0 = heapAllocCount();
+            long long t0 = monoNowNs();
+            s.onNoteInput(note, on);
+            long long dt = monoNowNs() - t0;
+            ops.add(dt, heapAllocCount() - a0);
+            if (playing && i % 16 == 15) s.onClock(); // Drena (fuera de la medición)
+        }
+        if (playing) s.onStop();
+        report(ctx, ops);
+    }
+}
+
+// Los callbacks de verdad, con los globales de main.cpp apuntando a destinos que cuentan:
+// un hilo manda 0xF8 a 300 BPM por mapleCallback y otro inunda con CCs del nanoKONTROL y
+// notas del acompañamiento. Mide el peor tick con contención real.
+static void benchCallbacks(BenchContext& ctx) {
+    CountingSink sink;
+    outSink = clockSink = &sink;
+    recorder = new Recorder("."); // Sin toma: record() es una lectura atómica
+    loadRouting("routing.yaml", routing);
+    seq = new Sequencer(&sink);
+    std::map<int, DrumStyle> drums;
+    std::map<int, AcompStyle> acomps;
+    buildStyles(drums, acomps);
+    seq->publishDatabases(compileDrumStyles(drums), compileAcompStyles(acomps));
+
+    const double BPM = 300;
+    const long long periodNs = (long long)(60e9 / (BPM * PPQN));
+    long clocks = (long)(ctx.opt.seconds * 1e9 / periodNs);
+    Samples clockSamples("mapleCallback 0xF8 (300 BPM + flood)", clocks);
+    size_t floodOps = (size_t)(ctx.opt.seconds * 20000); // Un CC cada 50 us como mucho
+    Samples ccSamples("korgCallback CC (flood)", floodOps);
+    Samples noteSamples("mapleCallback nota (flood)", floodOps / 4 + 1);
+    clockSamples.countAllocs = ccSamples.countAllocs = noteSamples.countAllocs = false;
+    std::atomic<bool> done{false};
+
+    std::thread flood([&]() {
+        static const int KORG_CCS[] = { 2, 3, 4, 6, 12, 17, 13 };
+        std::vector<unsigned char> cc(3), note(3);
+        unsigned i = 0;
+        while (!done.load(std::memory_order_relaxed)) {
+            cc[0] = 0xB0;
+            cc[1] = (unsigned char)KORG_CCS[i % 7];
+            cc[2] = (unsigned char)(i & 0x7F);
+            long long t0 = monoNowNs();
+            korgCallback(0, &cc, nullptr);
+            ccSamples.add(monoNowNs() - t0);
+
+            if (i % 4 == 0) {
+                const int* chord = CHORDS[(i / 80) % N_CHORDS];
+                note[0] = (unsigned char)(((i / 40) % 2 ? 0x80 : 0x90) | CHAN_INPUT_ACOMP);
+                note[1] = (unsigned char)chord[(i / 4) % 10];
+                note[2] = 100;
+                t0 = monoNowNs();
+                mapleCallback(0, &note, nullptr);
+                noteSamples.add(monoNowNs() - t0);
+            }
+            i++;
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    });
+
+    std::vector<unsigned char> msg(1);
+    msg[0] = 0xFA;
+    mapleCallback(0, &msg, nullptr);
+    msg[0] = 0xF8;
+    long long next = monoNowNs();
+    for (long c = 0; c < clocks; c++) {
+        next += periodNs;
+        long long t0 = monoNowNs();
+        mapleCallback(0, &msg, nullptr);
+        clockSamples.add(monoNowNs() - t0);
+        timespec ts = { (time_t)(next / 1000000000LL), (long)(next % 1000000000LL) };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+    }
+    done = true;
+    flood.join();
+    msg[0] = 0xFC;
+    mapleCallback(0, &msg, nullptr);
+
+    report(ctx, clockSamples);
+    report(ctx, ccSamples);
+    report(ctx, noteSamples);
+
+    delete seq;
+    seq = nullptr;
+    delete recorder;
+    recorder = nullptr;
+    outSink = clockSink = nullptr;
+}
+
+// Un puerto que tarda en cada envío (un USB-MIDI saturado)
+class SlowSink : public CountingSink {
+public:
+    void send(const unsigned char* data, size_t size, long long delayNs = 0) override {
+        CountingSink::send(data, size, delayNs);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+};
+
+// Reparto a un destino rápido y uno lento: el send del secuenciador no tiene que enterarse
+// del lento, que solo pierde lo que no le entra en la cola
+static void benchFanout(BenchContext& ctx) {
+    CountingSink fast;
+    SlowSink slow;
+    OutputDestination fastDest("Bench rápido", &fast);
+    OutputDestination slowDest("Bench lento", &slow);
+    OutputFanout fanout;
+    fanout.add(&fastDest);
+    fanout.add(&slowDest);
+    fastDest.start();
+    slowDest.start();
+
+    // Un paso típico: bombo, hi-hat y un acorde de tres notas con running status
+    static const unsigned char STEP[] = { 0x99, 36, 110, 42, 80, 0x94, 60, 90, 64, 90, 67, 90 };
+    long ops = ctx.opt.noteOps / 10;
+    Samples samples("OutputFanout::send (destino de 2 ms)", ops);
+    samples.countAllocs = false; // Los hilos de los destinos corren a la par
+    for (long i = 0; i < ops; i++) {
+        long long t0 = monoNowNs();
+        fanout.send(STEP, sizeof(STEP));
+        samples.add(monoNowNs() - t0);
+        if (i % 16 == 15) std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    fastDest.stop();
+    slowDest.stop();
+    report(ctx, samples);
+
+    OutputDestStats fs = fastDest.stats(), ss = slowDest.stats();
+    std::cout << "  rápido: " << fs.messages << " mensajes, " << fs.dropped << " perdidos; lento: " << ss.messages
+              << " mensajes, " << ss.dropped << " perdidos, peor envío " << ss.maxSendUs << " us" << std::endl;
+}
+
+int runBench(int argc, char** argv) {
+    BenchOptions opt;
+    for (int i = 2; i < argc; i++) {
+        std::string a = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (a == "--help" || a == "-h") { printUsage(); return 0; }
+        if (!hasValue) { std::cerr << "Falta valor para " << a << std::endl; printUsage(); return 1; }
+        std::string v = argv[++i];
+        if (a == "--ticks") opt.ticks = std::stol(v);
+        else if (a == "--note-ops") opt.noteOps = std::stol(v);
+        else if (a == "--seconds") opt.seconds = std::stod(v);
+        else if (a == "--out") opt.out = v;
+        else if (a == "--tag") opt.tag = v;
+        else { std::cerr << "Opción desconocida: " << a << std::endl; printUsage(); return 1; }
+    }
+    if (opt.ticks <= 0 || opt.noteOps <= 0 || opt.seconds <= 0) {
+        std::cerr << "--ticks, --note-ops y --seconds tienen que ser positivos" << std::endl;
+        return 1;
+    }
+
+    std::ofstream out(opt.out, std::ios::app);
+    if (!out) {
+        std::cerr << "Error Bench: no se pudo escribir " << opt.out << std::endl;
+        return 1;
+    }
+    char host[64] = "";
+    gethostname(host, sizeof(host) - 1);
+    BenchContext ctx = { opt, out, host, (long long)time(nullptr) };
+
+    std::cout << "Bench" << (opt.tag.empty() ? "" : " " + opt.tag) << (ALLOCS_COUNTED ? "" : " (sin ALLOC_DEBUG: no se cuentan alocaciones)")
+              << std::endl;
+    benchClock(ctx, 0, "onClock (32 pasos, 8 pistas, 3 partes)", "onClock con paso (batería + acomp)");
+    benchClock(ctx, 1, "onClock (solo acomp, 3 partes)", "onClock con paso (playAcompStep)");
+    benchNoteInput(ctx);
+    benchCallbacks(ctx);
+    benchFanout(ctx);
+    std::cout << "Resultados agregados a " << opt.out << std::endl;
+    return 0;
+}
@@ -0,0 +1,303 @@
+#include "electone.h"
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <chrono>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// --- CACHÉ BINARIO DE SONIDOS Y ESTILOS ---
+// Guarda las tablas ya compiladas; al arrancar se mapea el archivo y los arreglos se
+// copian en bloque, sin YAML ni conversión entrada por entrada. Se invalida solo cuando
+// cambia el hash del contenido de los tres YAML (o la versión del formato).
+
+static const char CACHE_MAGIC[8] = {'E', 'L', 'E', 'C', 'A', 'C', 'H', 'E'};
+static const uint32_t CACHE_VERSION = 5;
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t sourceHash;
+    uint32_t nSounds;
+    uint32_t nLeadSounds;
+    uint32_t nDrumStyles;
+    uint32_t nAcompStyles;
+};
+struct SoundRec { int32_t id, bank, program, portamento, portamentoTime; };
+struct DrumStyleRec { int32_t id, steps, nVariations, nFills, swing, humanize; };
+struct PatternRec { int32_t steps, nEvents; };
+struct AcompStyleRec { int32_t id, nPatterns; };
+struct AcompPatRec { int32_t valid, steps, nParts, nEvents; };
+struct AcompPartRec { int32_t mode, channel, program, velocity, baseNote, voiceLead; };
+
+static_assert(sizeof(StepEvent) == 4, "StepEvent tiene que estar empaquetado");
+static_assert(sizeof(AcompEvent) == 4, "AcompEvent tiene que estar empaquetado");
+
+// FNV-1a de 64 bits sobre el contenido de los archivos
+static uint64_t hashFiles(const std::vector<std::string>& files) {
+    uint64_t h = 1469598103934665603ULL ^ CACHE_VERSION;
+    for (const std::string& f : files) {
+        std::ifstream in(f, std::ios::binary);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        std::string data = ss.str();
+        for (unsigned char c : data) { h ^= c; h *= 1099511628211ULL; }
+        h ^= 0xFF; h *= 1099511628211ULL; // Separador entre archivos
+    }
+    return h;
+}
+
+// --- ESCRITURA ---
+class CacheWriter {
+public:
+    std::vector<unsigned char> buf;
+    void put(const void* p, size_t n) {
+        const unsigned char* b = (const unsigned char*)p;
+        buf.insert(buf.end(), b, b + n);
+        while (buf.size() % 4) buf.push_back(0); // Todo alineado a 4
+    }
+    template <typename T> void put(const T& v) { put(&v, sizeof(T)); }
+};
+
+static void putPattern(CacheWriter& w, const CompiledPattern& p) {
+    PatternRec r = { p.steps, (int32_t)p.events.size() };
+    w.put(r);
+    if (p.steps == 0) return;
+    w.put(p.offsets.data(), p.offsets.size() * sizeof(unsigned short));
+    w.put(p.events.data(), p.events.size() * sizeof(StepEvent));
+}
+
+static void putSounds(CacheWriter& w, const std::map<int, SoundPatch>& db) {
+    for (auto const& [id, p] : db) {
+        SoundRec r = { id, p.bank, p.program, p.portamento ? 1 : 0, p.portamentoTime };
+        w.put(r);
+    }
+}
+
+static bool writeCache(const std::string& path, uint64_t hash, const EngineData& d) {
+    CacheWriter w;
+    CacheHeader h;
+    memcpy(h.magic, CACHE_MAGIC, 8);
+    h.version = CACHE_VERSION;
+    h.headerSize = sizeof(CacheHeader);
+    h.sourceHash = hash;
+    h.nSounds = d.generalSounds.size();
+    h.nLeadSounds = d.leadSounds.size();
+    h.nDrumStyles = 0;
+    for (const auto& ds : d.drums) if (ds.valid) h.nDrumStyles++;
+    h.nAcompStyles = 0;
+    for (const auto& as : d.acomps) if (as.valid) h.nAcompStyles++;
+    w.put(h);
+
+    putSounds(w, d.generalSounds);
+    putSounds(w, d.leadSounds);
+
+    for (size_t id = 0; id < d.drums.size(); id++) {
+        const CompiledDrumStyle& ds = d.drums[id];
+        if (!ds.valid) continue;
+        DrumStyleRec r = { (int32_t)id, ds.steps, (int32_t)ds.variations.size(), (int32_t)ds.fills.size(), ds.swing, ds.humanize };
+        w.put(r);
+        for (const auto& p : ds.variations) putPattern(w, p);
+        for (const auto& p : ds.fills) putPattern(w, p);
+        for (const auto& p : ds.resolutions) putPattern(w, p);
+    }
+    for (size_t id = 0; id < d.acomps.size(); id++) {
+        const CompiledAcompStyle& as = d.acomps[id];
+        if (!as.valid) continue;
+        AcompStyleRec r = { (int32_t)id, (int32_t)as.patterns.size() };
+        w.put(r);
+        for (const auto& ap : as.patterns) {
+            AcompPatRec pr = { ap.valid ? 1 : 0, ap.valid ? ap.steps : 0, (int32_t)ap.parts.size(), (int32_t)ap.events.size() };
+            w.put(pr);
+            if (!ap.valid) continue;
+            for (const CompiledAcompPart& part : ap.parts) {
+                AcompPartRec r = { (int32_t)part.mode, part.channel, part.program, part.velocity, part.baseNote, part.voiceLead ? 1 : 0 };
+                w.put(r);
+            }
+            w.put(ap.offsets.data(), ap.offsets.size() * sizeof(unsigned short));
+            w.put(ap.events.data(), ap.events.size() * sizeof(AcompEvent));
+        }
+    }
+
+    // Escritura atómica: nunca queda un caché a medias
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream f(tmp, std::ios::binary);
+        if (!f) return false;
+        f.write((const char*)w.buf.data(), w.buf.size());
+        if (!f) return false;
+    }
+    return rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+// --- LECTURA (mmap) ---
+class CacheReader {
+public:
+    CacheReader(const unsigned char* base, size_t size) : p(base), end(base + size) {}
+    const void* take(size_t n) {
+        size_t padded = (n + 3) & ~(size_t)3;
+        if ((size_t)(end - p) < padded) throw std::runtime_error("caché truncado");
+        const void* r = p;
+        p += padded;
+        return r;
+    }
+    template <typename T> T get() { T v; memcpy(&v, take(sizeof(T)), sizeof(T)); return v; }
+
+private:
+    const unsigned char* p;
+    const unsigned char* end;
+};
+
+// El clock recorre offsets[s]..offsets[s + 1]: tienen que arrancar en 0, no bajar y cerrar en nEvents
+static void checkOffsets(const std::vector<unsigned short>& offsets, int nEvents) {
+    if (offsets.front() != 0 || offsets.back() != nEvents) throw std::runtime_error("patrón inválido");
+    for (size_t i = 1; i < offsets.size(); i++) if (offsets[i] < offsets[i - 1]) throw std::runtime_error("patrón inválido");
+}
+
+// steps: los que pide el estilo (0 = hueco entre ids, sin patrón)
+static CompiledPattern getPattern(CacheReader& r, int steps) {
+    PatternRec pr = r.get<PatternRec>();
+    CompiledPattern p;
+    p.steps = pr.steps;
+    if (pr.steps == 0) return p;
+    if (pr.steps != steps || pr.nEvents < 0 || pr.nEvents > 65535) throw std::runtime_error("patrón inválido");
+    const unsigned short* offs = (const unsigned short*)r.take((pr.steps + 1) * sizeof(unsigned short));
+    p.offsets.assign(offs, offs + pr.steps + 1);
+    const StepEvent* evs = (const StepEvent*)r.take(pr.nEvents * sizeof(StepEvent));
+    p.events.assign(evs, evs + pr.nEvents);
+    checkOffsets(p.offsets, pr.nEvents);
+    for (const StepEvent& ev : p.events) if (ev.gate > MAX_GATE_TICKS) throw std::runtime_error("gate inválido");
+    return p;
+}
+
+static void getSounds(CacheReader& r, uint32_t n, std::map<int, SoundPatch>& db) {
+    for (uint32_t i = 0; i < n; i++) {
+        SoundRec s = r.get<SoundRec>();
+        db[s.id] = { s.bank, s.program, s.portamento != 0, s.portamentoTime };
+    }
+}
+
+static bool readCache(const std::string& path, uint64_t hash, EngineData& d) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(CacheHeader)) { close(fd); return false; }
+    size_t size = st.st_size;
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+
+    bool ok = false;
+    try {
+        CacheReader r((const unsigned char*)map, size);
+        CacheHeader h = r.get<CacheHeader>();
+        if (memcmp(h.magic, CACHE_MAGIC, 8) != 0 || h.version != CACHE_VERSION ||
+            h.headerSize != sizeof(CacheHeader) || h.sourceHash != hash) {
+            throw std::runtime_error("desactualizado");
+        }
+        EngineData tmp;
+        getSounds(r, h.nSounds, tmp.generalSounds);
+        getSounds(r, h.nLeadSounds, tmp.leadSounds);
+
+        for (uint32_t i = 0; i < h.nDrumStyles; i++) {
+            DrumStyleRec sr = r.get<DrumStyleRec>();
+            if (sr.id < 0 || sr.id > 127 || sr.nVariations < 0 || sr.nVariations > 128 || sr.nFills < 0 || sr.nFills > 128 ||
+                sr.steps < 1 || sr.steps > 256 || sr.swing < 0 || sr.swing > 5 || sr.humanize < 0 || sr.humanize > 64) {
+                throw std::runtime_error("estilo inválido");
+            }
+            CompiledDrumStyle ds;
+            ds.valid = true;
+            ds.steps = sr.steps;
+            ds.swing = (unsigned char)sr.swing;
+            ds.humanize = (unsigned char)sr.humanize;
+            for (int v = 0; v < sr.nVariations; v++) ds.variations.push_back(getPattern(r, sr.steps));
+            for (int f = 0; f < sr.nFills; f++) ds.fills.push_back(getPattern(r, sr.steps));
+            for (int f = 0; f < sr.nFills; f++) ds.resolutions.push_back(getPattern(r, 1)); // El remate es un solo paso
+            if ((int)tmp.drums.size() <= sr.id) tmp.drums.resize(sr.id + 1);
+            tmp.drums[sr.id] = std::move(ds);
+        }
+        for (uint32_t i = 0; i < h.nAcompStyles; i++) {
+            AcompStyleRec sr = r.get<AcompStyleRec>();
+            if (sr.id < 0 || sr.id > 127 || sr.nPatterns < 0 || sr.nPatterns > 128) throw std::runtime_error("acomp inválido");
+            CompiledAcompStyle as;
+            as.valid = true;
+            for (int p = 0; p < sr.nPatterns; p++) {
+                AcompPatRec pr = r.get<AcompPatRec>();
+                CompiledAcompPattern ap;
+                if (pr.valid) {
+                    if (pr.steps <= 0 || pr.steps > MAX_ACOMP_STEPS || pr.nParts <= 0 || pr.nParts > MAX_ACOMP_PARTS ||
+                        pr.nEvents < 0 || pr.nEvents > 65535)
+                        throw std::runtime_error("patrón inválido");
+                    ap.valid = true;
+                    ap.steps = pr.steps;
+                    for (int i = 0; i < pr.nParts; i++) {
+                        AcompPartRec rec = r.get<AcompPartRec>();
+                        if (rec.mode < 0 || rec.mode > (int32_t)AcompMode::Degree || rec.channel < 0 || rec.channel > 15)
+                            throw std::runtime_error("parte inválida");
+                        CompiledAcompPart part;
+                        part.mode = (AcompMode)rec.mode;
+                        part.channel = (unsigned char)rec.channel;
+                        part.program = (unsigned char)rec.program;
+                        part.velocity = (unsigned char)rec.velocity;
+                        part.baseNote = rec.baseNote;
+                        part.voiceLead = rec.voiceLead != 0;
+                        ap.parts.push_back(part);
+                    }
+                    const unsigned short* offs = (const unsigned short*)r.take((pr.steps + 1) * sizeof(unsigned short));
+                    ap.offsets.assign(offs, offs + pr.steps + 1);
+                    const AcompEvent* evs = (const AcompEvent*)r.take(pr.nEvents * sizeof(AcompEvent));
+                    ap.events.assign(evs, evs + pr.nEvents);
+                    checkOffsets(ap.offsets, pr.nEvents);
+                    for (const AcompEvent& ev : ap.events) {
+                        if (ev.part >= pr.nParts || ev.gate > MAX_GATE_TICKS) throw std::runtime_error("patrón inválido");
+                        if (ap.parts[ev.part].mode == AcompMode::Degree && ev.value > 9) throw std::runtime_error("grado inválido");
+                    }
+                }
+                as.patterns.push_back(std::move(ap));
+            }
+            if ((int)tmp.acomps.size() <= sr.id) tmp.acomps.resize(sr.id + 1);
+            tmp.acomps[sr.id] = std::move(as);
+        }
+        d = std::move(tmp);
+        ok = true;
+    } catch (const std::exception& e) {
+        std::cout << "Caché " << path << ": " << e.what() << ", se regenera" << std::endl;
+    }
+    munmap(map, size);
+    return ok;
+}
+
+// --- ENTRADA ---
+EngineLoad loadEngineData(const std::string& soundsFile, const std::string& ritmosFile, const std::string& chordsFile,
+                    const std::string& cachePath, EngineData& d) {
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t hash = hashFiles({soundsFile, ritmosFile, chordsFile});
+
+    if (readCache(cachePath, hash, d)) {
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        std::cout << "Datos desde caché " << cachePath << " en " << ms << " ms" << std::endl;
+        return EngineLoad::Cache;
+    }
+
+    bool okSounds = loadInstrumentDB(soundsFile);
+    d.generalSounds = generalSoundsDB;
+    d.leadSounds = leadSoundsDB;
+    bool okDrums, okAcomps, okDrumsCompiled, okAcompsCompiled;
+    d.drums = compileDrumStyles(loadDrumStyles(ritmosFile, &okDrums), &okDrumsCompiled);
+    d.acomps = compileAcompStyles(loadAcompStyles(chordsFile, &okAcomps), &okAcompsCompiled);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    // Un caché de datos a medias se cargaría sin avisar la próxima vez
+    if (!(okSounds && okDrums && okAcomps && okDrumsCompiled && okAcompsCompiled)) {
+        std::cerr << "Datos desde YAML en " << ms << " ms, con errores (no se escribe el caché)" << std::endl;
+        return EngineLoad::Error;
+    }
+    bool written = writeCache(cachePath, hash, d);
+    std::cout << "Datos desde YAML en " << ms << " ms" << (written ? " (caché regenerado)" : " (no se pudo escribir el caché)") << std::endl;
+    return EngineLoad::Yaml;
+}
@@ -0,0 +1,128 @@
+#include "electone.h"
+
+// --- RECONOCIMIENTO DE ACORDES ---
+// Las 4096 combinaciones de clases de altura, por cada bajo posible, se resuelven una sola
+// vez al arrancar; en tiempo de ejecución reconocer un acorde es leer una celda de la tabla.
+
+// Intervalos por grado (índice 1..9; 0 sin usar). -1 = el acorde no tiene ese grado.
+// Cuando una máscara admite dos lecturas (Am7 = C6, Gsus4 = Csus2, Am7b5 = Cm6) gana la que
+// tiene de raíz al bajo tocado; si ninguna, el orden de la tabla.
+static const ChordTypeDef CHORD_DEFS[CHORD_TYPES] = {
+    // nombre   -  1  2  3  4  5  6   7   8   9
+    { "",      {0, 0, 2, 4, 5, 7, 9, -1, 12, 14} }, // CHORD_NONE (no se usa para reconocer)
+    { "",      {0, 0, 2, 4, 5, 7, 9, -1, 12, 14} }, // Mayor
+    { "m",     {0, 0, 2, 3, 5, 7, 8, -1, 12, 14} }, // Menor
+    { "7",     {0, 0, 2, 4, 5, 7, 9, 10, 12, 14} }, // Séptima de dominante
+    { "m7",    {0, 0, 2, 3, 5, 7, 8, 10, 12, 14} },
+    { "maj7",  {0, 0, 2, 4, 5, 7, 9, 11, 12, 14} },
+    { "dim",   {0, 0, 2, 3, 5, 6, 8, -1, 12, 14} },
+    { "aug",   {0, 0, 2, 4, 5, 8, 9, -1, 12, 14} },
+    { "sus4",  {0, 0, 2, 5, 5, 7, 9, -1, 12, 14} },
+    { "sus2",  {0, 0, 2, 2, 5, 7, 9, -1, 12, 14} },
+    { "m7b5",  {0, 0, 2, 3, 5, 6, 8, 10, 12, 14} },
+    { "dim7",  {0, 0, 2, 3, 5, 6, 8,  9, 12, 14} },
+    { "mMaj7", {0, 0, 2, 3, 5, 7, 8, 11, 12, 14} },
+    { "6",     {0, 0, 2, 4, 5, 7, 9, -1, 12, 14} },
+    { "m6",    {0, 0, 2, 3, 5, 7, 9, -1, 12, 14} },
+    { "7sus4", {0, 0, 2, 5, 5, 7, 9, 10, 12, 14} },
+};
+
+// Máscara de cada tipo con raíz en C (bit 0)
+static const unsigned short TYPE_MASKS[CHORD_TYPES] = {
+    0,
+    (1 << 0) | (1 << 4) | (1 << 7),              // Mayor
+    (1 << 0) | (1 << 3) | (1 << 7),              // Menor
+    (1 << 0) | (1 << 4) | (1 << 7) | (1 << 10),  // 7
+    (1 << 0) | (1 << 3) | (1 << 7) | (1 << 10),  // m7
+    (1 << 0) | (1 << 4) | (1 << 7) | (1 << 11),  // maj7
+    (1 << 0) | (1 << 3) | (1 << 6),              // dim
+    (1 << 0) | (1 << 4) | (1 << 8),              // aug
+    (1 << 0) | (1 << 5) | (1 << 7),              // sus4
+    (1 << 0) | (1 << 2) | (1 << 7),              // sus2
+    (1 << 0) | (1 << 3) | (1 << 6) | (1 << 10),  // m7b5
+    (1 << 0) | (1 << 3) | (1 << 6) | (1 << 9),   // dim7
+    (1 << 0) | (1 << 3) | (1 << 7) | (1 << 11),  // mMaj7
+    (1 << 0) | (1 << 4) | (1 << 7) | (1 << 9),   // 6
+    (1 << 0) | (1 << 3) | (1 << 7) | (1 << 9),   // m6
+    (1 << 0) | (1 << 5) | (1 << 7) | (1 << 10),  // 7sus4
+};
+
+static inline unsigned rotate12(unsigned mask, int root) {
+    return ((mask << root) | (mask >> (12 - root))) & 0xFFF;
+}
+
+static inline int bits(unsigned v) { return __builtin_popcount(v); }
+
+// Mejor lectura de una máscara: primero coincidencia exacta; si no, el acorde más grande
+// contenido en lo tocado (sobran tensiones); si no, el más chico que contiene lo tocado
+// (falta la quinta, p.ej.). La raíz siempre tiene que estar tocada; a igual puntaje, la
+// lectura con raíz en el bajo.
+static ChordInfo classify(unsigned mask, int bass) {
+    ChordInfo none = { 0, CHORD_NONE };
+    if (mask == 0) return none;
+    if (bits(mask) == 1) return { (unsigned char)__builtin_ctz(mask), CHORD_MAJ };
+
+    ChordInfo best = none;
+    for (int t = 1; t < CHORD_TYPES; t++)
+        for (int r = 0; r < 12; r++)
+            if ((mask >> r) & 1 && rotate12(TYPE_MASKS[t], r) == mask) {
+                if (r == bass) return { (unsigned char)r, (ChordType)t };
+                if (best.type == CHORD_NONE) best = { (unsigned char)r, (ChordType)t };
+            }
+    if (best.type != CHORD_NONE) return best;
+
+    int bestBits = 0;
+    for (int t = 1; t < CHORD_TYPES; t++)
+        for (int r = 0; r < 12; r++) {
+            unsigned tm = rotate12(TYPE_MASKS[t], r);
+            if (!((mask >> r) & 1) || (tm & mask) != tm) continue;
+            if (bits(tm) > bestBits || (bits(tm) == bestBits && r == bass && best.root != bass)) {
+                best = { (unsigned char)r, (ChordType)t };
+                bestBits = bits(tm);
+            }
+        }
+    if (best.type != CHORD_NONE) return best;
+
+    int bestSize = 99;
+    for (int t = 1; t < CHORD_TYPES; t++)
+        for (int r = 0; r < 12; r++) {
+            unsigned tm = rotate12(TYPE_MASKS[t], r);
+            if (!((mask >> r) & 1) || (tm & mask) != mask) continue;
+            if (bits(tm) < bestSize || (bits(tm) == bestSize && r == bass && best.root != bass)) {
+                best = { (unsigned char)r, (ChordType)t };
+                bestSize = bits(tm);
+            }
+        }
+    return best;
+}
+
+struct ChordTable {
+    ChordInfo cells[12][4096]; // [bajo][máscara]: ~96 KB
+    ChordTable() {
+        for (int b = 0; b < 12; b++)
+            for (unsigned m = 0; m < 4096; m++) cells[b][m] = classify(m, b);
+    }
+};
+static const ChordTable chordTable;
+
+ChordInfo recognizeChord(unsigned pitchClassMask, int bassPitchClass) {
+    return chordTable.cells[(unsigned)bassPitchClass % 12][pitchClassMask & 0xFFF];
+}
+
+const ChordTypeDef& chordTypeDef(ChordType type) { return CHORD_DEFS[type < CHORD_TYPES ? type : CHORD_NONE]; }
+
+// Single finger (como en el Electone): la tecla más aguda es la raíz; una negra más abajo
+// la hace menor, una blanca más abajo la hace séptima, y ambas, menor séptima.
+ChordInfo singleFingerChord(const NoteSet& held) {
+    int root = held.highest();
+    if (root < 0) return { 0, CHORD_NONE };
+    bool black = false, white = false;
+    held.forEach([&](int note) {
+        if (note == root) return;
+        int pc = note % 12;
+        bool isBlack = (pc == 1 || pc == 3 || pc == 6 || pc == 8 || pc == 10);
+        if (isBlack) black = true; else white = true;
+    });
+    ChordType t = black ? (white ? CHORD_MIN7 : CHORD_MIN) : (white ? CHORD_DOM7 : CHORD_MAJ);
+    return { (unsigned char)(root % 12), t };
+}
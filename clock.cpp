@@ -0,0 +1,182 @@
+#include "electone.h"
+#include <time.h>
+#include <cerrno>
+#include <cmath>
+
+static const long NS_PER_SEC = 1000000000L;
+
+static inline long long toNs(const timespec& t) { return (long long)t.tv_sec * NS_PER_SEC + t.tv_nsec; }
+
+static inline timespec fromNs(long long ns) {
+    timespec t;
+    t.tv_sec = ns / NS_PER_SEC;
+    t.tv_nsec = ns % NS_PER_SEC;
+    return t;
+}
+
+static inline long long nowNs() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return toNs(t);
+}
+
+InternalClock::InternalClock(Sequencer* s, MidiSink* o, double b) : seq(s), out(o), bpm(120.0) { setBpm(b); }
+
+InternalClock::~InternalClock() { stop(); }
+
+void InternalClock::setBpm(double b) {
+    if (b < 20.0) b = 20.0;
+    if (b > 300.0) b = 300.0;
+    bpm.store(b);
+}
+
+void InternalClock::start() {
+    std::lock_guard<std::mutex> lock(workerMtx);
+    if (running.load()) return;
+    // Un stop pedido hace poco: el hilo anterior sale en a lo sumo un tick (su informe se pierde)
+    if (worker.joinable()) worker.join();
+    finished = false;
+    ticks = 0; jitterSumUs = 0; maxJitterUs = 0; maxLateUs = 0;
+    running = true;
+    worker = std::thread(&InternalClock::run, this);
+}
+
+void InternalClock::requestStop() { running = false; }
+
+void InternalClock::stop() {
+    running = false;
+    std::lock_guard<std::mutex> lock(workerMtx);
+    if (!worker.joinable()) return;
+    worker.join();
+    report();
+}
+
+bool InternalClock::reap() {
+    std::lock_guard<std::mutex> lock(workerMtx);
+    if (!worker.joinable() || !finished.load(std::memory_order_acquire)) return false;
+    worker.join(); // Ya terminó: no espera
+    report();
+    return true;
+}
+
+void InternalClock::report() const {
+    ClockStats st = stats();
+    std::cout << "Clock interno: " << st.ticks << " ticks a " << getBpm() << " BPM, jitter medio "
+              << st.meanJitterUs << " us, máximo " << st.maxJitterUs << " us, atraso máximo "
+              << st.maxLateUs << " us" << std::endl;
+}
+
+ClockStats InternalClock::stats() const {
+    unsigned long n = ticks.load();
+    return { n, n > 1 ? jitterSumUs.load() / (n - 1) : 0.0, maxJitterUs.load(), maxLateUs.load() };
+}
+
+void InternalClock::sendRealtime(unsigned char status) {
+    out->send(&status, 1);
+}
+
+// --- HILO DEL CLOCK ---
+void InternalClock::run() {
+    enterRealtimeThread("Clock interno");
+    seq->onStart();
+    sendRealtime(0xFA);
+
+    long long deadline = nowNs();
+    long long lastWake = 0;
+
+    while (running.load(std::memory_order_relaxed)) {
+        timespec ts = fromNs(deadline);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+
+        CallbackTimer timer;
+        long long now = nowNs();
+        long long period = (long long)(60.0 * NS_PER_SEC / (bpm.load(std::memory_order_relaxed) * PPQN));
+
+        sendRealtime(0xF8);
+        seq->onClock();
+
+        // Medición: atraso contra el deadline y desvío del período real
+        double lateUs = (now - deadline) / 1000.0;
+        if (lateUs > maxLateUs.load(std::memory_order_relaxed)) maxLateUs.store(lateUs, std::memory_order_relaxed);
+        if (lastWake != 0) {
+            double jitterUs = std::fabs((double)(now - lastWake - period)) / 1000.0;
+            jitterSumUs.store(jitterSumUs.load(std::memory_order_relaxed) + jitterUs, std::memory_order_relaxed);
+            if (jitterUs > maxJitterUs.load(std::memory_order_relaxed)) maxJitterUs.store(jitterUs, std::memory_order_relaxed);
+        }
+        lastWake = now;
+        ticks.fetch_add(1, std::memory_order_relaxed);
+
+        // Próximo deadline absoluto; si nos colgamos varios ticks, resincronizamos en vez de ráfaga
+        deadline += period;
+        if (now - deadline > 4 * period) deadline = now + period;
+    }
+
+    sendRealtime(0xFC);
+    seq->onStop();
+    finished.store(true, std::memory_order_release);
+}
+
+// --- PLL DEL CLOCK ENTRANTE ---
+void ClockPll::unlock(long long now) {
+    isLocked = false;
+    goodIntervals = 0;
+    badTicks = 0;
+    phaseNs = now;
+}
+
+void ClockPll::onTick(long long now) {
+    long long interval = lastRawNs ? now - lastRawNs : 0;
+    lastRawNs = now;
+    if (interval <= 0) {
+        phaseNs = now;
+        return;
+    }
+    metrics.clockInterval.record(interval);
+
+    // Más de 4 períodos sin ticks: el clock se paró. El tempo viejo no sirve (al volver
+    // puede venir a otro): el próximo intervalo siembra el período de cero
+    if (periodNs > 0 && interval > 4 * periodNs) {
+        if (isLocked) stops.fetch_add(1, std::memory_order_relaxed);
+        unlock(now);
+        periodNs = 0;
+        return;
+    }
+
+    if (!isLocked) {
+        bool similar = periodNs > 0 && std::fabs(interval - periodNs) < periodNs / 8;
+        periodNs = (periodNs == 0) ? (double)interval : periodNs + (interval - periodNs) / 8.0;
+        phaseNs = now;
+        goodIntervals = similar ? goodIntervals + 1 : 0;
+        if (goodIntervals >= LOCK_INTERVALS) {
+            isLocked = true;
+            locks.fetch_add(1, std::memory_order_relaxed);
+        }
+        return;
+    }
+
+    long long expected = phaseNs + (long long)periodNs;
+    double err = (double)(now - expected);
+    if (std::fabs(err) > periodNs / 4) {
+        // Un paquete USB demorado corre uno o dos ticks: se sigue la predicción. Si persiste, cambió el tempo
+        if (++badTicks < JUMP_TICKS) {
+            phaseNs = expected;
+            return;
+        }
+        jumps.fetch_add(1, std::memory_order_relaxed);
+        unlock(now);
+        periodNs = (double)interval;
+        return;
+    }
+    badTicks = 0;
+    phaseNs = expected + (long long)(ALPHA * err);
+    periodNs += BETA * err;
+
+    long long absErr = (long long)std::fabs(err);
+    metrics.clockPhaseError.record(absErr);
+    if (absErr > maxErrorNs.load(std::memory_order_relaxed)) maxErrorNs.store(absErr, std::memory_order_relaxed);
+}
+
+ClockPllStats ClockPll::stats() const {
+    return { locks.load(std::memory_order_relaxed), stops.load(std::memory_order_relaxed), jumps.load(std::memory_order_relaxed),
+             maxErrorNs.load(std::memory_order_relaxed) / 1000.0 };
+}
@@ -0,0 +1,221 @@
+#include "electone.h"
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// --- PANTALLA DEL PANEL ---
+// El hilo de la pantalla es el único que dibuja. Lee el seqlock del secuenciador y los
+// sonidos elegidos (atómicos sueltos), y si algo cambió redibuja el cuadro entero en
+// memoria; al panel solo van las franjas de filas que cambiaron, recortadas en x.
+
+// --- FUENTE 5x8 ---
+// ASCII 0x20..0x7A, una columna por byte (bit 0 = fila de arriba)
+static const unsigned char FONT[][5] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5F, 0x00, 0x00}, {0x00, 0x07, 0x00, 0x07, 0x00}, // ' ' ! "
+    {0x14, 0x7F, 0x14, 0x7F, 0x14}, {0x24, 0x2A, 0x7F, 0x2A, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62}, // # $ %
+    {0x36, 0x49, 0x56, 0x20, 0x50}, {0x00, 0x08, 0x07, 0x03, 0x00}, {0x00, 0x1C, 0x22, 0x41, 0x00}, // & ' (
+    {0x00, 0x41, 0x22, 0x1C, 0x00}, {0x2A, 0x1C, 0x7F, 0x1C, 0x2A}, {0x08, 0x08, 0x3E, 0x08, 0x08}, // ) * +
+    {0x00, 0x80, 0x70, 0x30, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08}, {0x00, 0x00, 0x60, 0x60, 0x00}, // , - .
+    {0x20, 0x10, 0x08, 0x04, 0x02}, {0x3E, 0x51, 0x49, 0x45, 0x3E}, {0x00, 0x42, 0x7F, 0x40, 0x00}, // / 0 1
+    {0x72, 0x49, 0x49, 0x49, 0x46}, {0x21, 0x41, 0x49, 0x4D, 0x33}, {0x18, 0x14, 0x12, 0x7F, 0x10}, // 2 3 4
+    {0x27, 0x45, 0x45, 0x45, 0x39}, {0x3C, 0x4A, 0x49, 0x49, 0x31}, {0x41, 0x21, 0x11, 0x09, 0x07}, // 5 6 7
+    {0x36, 0x49, 0x49, 0x49, 0x36}, {0x46, 0x49, 0x49, 0x29, 0x1E}, {0x00, 0x00, 0x14, 0x00, 0x00}, // 8 9 :
+    {0x00, 0x40, 0x34, 0x00, 0x00}, {0x00, 0x08, 0x14, 0x22, 0x41}, {0x14, 0x14, 0x14, 0x14, 0x14}, // ; < =
+    {0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x59, 0x09, 0x06}, {0x3E, 0x41, 0x5D, 0x59, 0x4E}, // > ? @
+    {0x7C, 0x12, 0x11, 0x12, 0x7C}, {0x7F, 0x49, 0x49, 0x49, 0x36}, {0x3E, 0x41, 0x41, 0x41, 0x22}, // A B C
+    {0x7F, 0x41, 0x41, 0x41, 0x3E}, {0x7F, 0x49, 0x49, 0x49, 0x41}, {0x7F, 0x09, 0x09, 0x09, 0x01}, // D E F
+    {0x3E, 0x41, 0x41, 0x51, 0x73}, {0x7F, 0x08, 0x08, 0x08, 0x7F}, {0x00, 0x41, 0x7F, 0x41, 0x00}, // G H I
+    {0x20, 0x40, 0x41, 0x3F, 0x01}, {0x7F, 0x08, 0x14, 0x22, 0x41}, {0x7F, 0x40, 0x40, 0x40, 0x40}, // J K L
+    {0x7F, 0x02, 0x1C, 0x02, 0x7F}, {0x7F, 0x04, 0x08, 0x10, 0x7F}, {0x3E, 0x41, 0x41, 0x41, 0x3E}, // M N O
+    {0x7F, 0x09, 0x09, 0x09, 0x06}, {0x3E, 0x41, 0x51, 0x21, 0x5E}, {0x7F, 0x09, 0x19, 0x29, 0x46}, // P Q R
+    {0x26, 0x49, 0x49, 0x49, 0x32}, {0x03, 0x01, 0x7F, 0x01, 0x03}, {0x3F, 0x40, 0x40, 0x40, 0x3F}, // S T U
+    {0x1F, 0x20, 0x40, 0x20, 0x1F}, {0x3F, 0x40, 0x38, 0x40, 0x3F}, {0x63, 0x14, 0x08, 0x14, 0x63}, // V W X
+    {0x03, 0x04, 0x78, 0x04, 0x03}, {0x61, 0x59, 0x49, 0x4D, 0x43}, {0x00, 0x7F, 0x41, 0x41, 0x00}, // Y Z [
+    {0x02, 0x04, 0x08, 0x10, 0x20}, {0x00, 0x41, 0x41, 0x7F, 0x00}, {0x04, 0x02, 0x01, 0x02, 0x04}, // \ ] ^
+    {0x40, 0x40, 0x40, 0x40, 0x40}, {0x00, 0x03, 0x07, 0x08, 0x00}, {0x20, 0x54, 0x54, 0x78, 0x40}, // _ ` a
+    {0x7F, 0x28, 0x44, 0x44, 0x38}, {0x38, 0x44, 0x44, 0x44, 0x28}, {0x38, 0x44, 0x44, 0x28, 0x7F}, // b c d
+    {0x38, 0x54, 0x54, 0x54, 0x18}, {0x00, 0x08, 0x7E, 0x09, 0x02}, {0x18, 0xA4, 0xA4, 0x9C, 0x78}, // e f g
+    {0x7F, 0x08, 0x04, 0x04, 0x78}, {0x00, 0x44, 0x7D, 0x40, 0x00}, {0x20, 0x40, 0x40, 0x3D, 0x00}, // h i j
+    {0x7F, 0x10, 0x28, 0x44, 0x00}, {0x00, 0x41, 0x7F, 0x40, 0x00}, {0x7C, 0x04, 0x78, 0x04, 0x78}, // k l m
+    {0x7C, 0x08, 0x04, 0x04, 0x78}, {0x38, 0x44, 0x44, 0x44, 0x38}, {0xFC, 0x18, 0x24, 0x24, 0x18}, // n o p
+    {0x18, 0x24, 0x24, 0x18, 0xFC}, {0x7C, 0x08, 0x04, 0x04, 0x08}, {0x48, 0x54, 0x54, 0x54, 0x24}, // q r s
+    {0x04, 0x04, 0x3F, 0x44, 0x24}, {0x3C, 0x40, 0x40, 0x20, 0x7C}, {0x1C, 0x20, 0x40, 0x20, 0x1C}, // t u v
+    {0x3C, 0x40, 0x30, 0x40, 0x3C}, {0x44, 0x28, 0x10, 0x28, 0x44}, {0x4C, 0x90, 0x90, 0x90, 0x7C}, // w x y
+    {0x44, 0x64, 0x54, 0x4C, 0x44},                                                                 // z
+};
+static const int FONT_FIRST = 0x20;
+static const int FONT_LAST = 0x7A;
+
+// RGB565
+static const uint16_t COLOR_BG = 0x0000;
+static const uint16_t COLOR_TEXT = 0xFFFF;
+static const uint16_t COLOR_DIM = 0x8410;
+static const uint16_t COLOR_CHORD = 0xFFE0;
+static const uint16_t COLOR_PLAY = 0x07E0;
+static const uint16_t COLOR_STOP = 0xF800;
+
+static const char* const ROOT_NAMES[12] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+
+// Texto en (x, y) con cada píxel de la fuente como un cuadrado de scale x scale; recorta en el borde
+static void drawText(uint16_t* fb, int x, int y, const char* text, uint16_t color, int scale = 1) {
+    for (; *text; text++, x += 6 * scale) {
+        int c = (unsigned char)*text;
+        if (c < FONT_FIRST || c > FONT_LAST) c = '?';
+        const unsigned char* glyph = FONT[c - FONT_FIRST];
+        for (int col = 0; col < 5; col++) {
+            for (int row = 0; row < 8; row++) {
+                if (!((glyph[col] >> row) & 1)) continue;
+                for (int dy = 0; dy < scale; dy++) {
+                    for (int dx = 0; dx < scale; dx++) {
+                        int px = x + col * scale + dx, py = y + row * scale + dy;
+                        if (px >= 0 && px < PANEL_W && py >= 0 && py < PANEL_H) fb[py * PANEL_W + px] = color;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void FileDisplaySink::endFrame(const uint16_t* fb) {
+    // Escritura atómica: quien mire el archivo nunca ve un cuadro a medias
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream f(tmp, std::ios::binary);
+        if (!f) return;
+        f << "P6\n" << PANEL_W << " " << PANEL_H << "\n255\n";
+        unsigned char row[PANEL_W * 3];
+        for (int y = 0; y < PANEL_H; y++) {
+            for (int x = 0; x < PANEL_W; x++) {
+                uint16_t c = fb[y * PANEL_W + x];
+                row[x * 3] = (unsigned char)(((c >> 11) & 0x1F) * 255 / 31);
+                row[x * 3 + 1] = (unsigned char)(((c >> 5) & 0x3F) * 255 / 63);
+                row[x * 3 + 2] = (unsigned char)((c & 0x1F) * 255 / 31);
+            }
+            f.write((const char*)row, sizeof(row));
+        }
+    }
+    rename(tmp.c_str(), path.c_str());
+}
+
+PanelDisplay::PanelDisplay(const Sequencer* s, DisplaySink* k, int period) : seq(s), sink(k), periodMs(period) {}
+
+PanelDisplay::~PanelDisplay() { stop(); }
+
+void PanelDisplay::start() {
+    if (running.exchange(true)) return;
+    worker = std::thread(&PanelDisplay::run, this);
+}
+
+void PanelDisplay::stop() {
+    if (!running.exchange(false)) return;
+    if (worker.joinable()) worker.join();
+}
+
+DisplayStats PanelDisplay::stats() const {
+    return { frames.load(std::memory_order_relaxed), rects.load(std::memory_order_relaxed), pixels.load(std::memory_order_relaxed) };
+}
+
+void PanelDisplay::render(const PanelState& st, const short* sounds) {
+    for (uint16_t& p : next) p = COLOR_BG;
+    char line[32];
+
+    snprintf(line, sizeof(line), "Ritmo %d  Var %d", st.style, st.var);
+    drawText(next, 4, 4, line, COLOR_TEXT);
+    if (st.fill > 0) {
+        snprintf(line, sizeof(line), "Fill %d", st.fill);
+        drawText(next, 4, 16, line, COLOR_CHORD);
+    }
+    snprintf(line, sizeof(line), "Acomp %d  Oct %+d", st.acompPattern, st.octave);
+    drawText(next, 4, 28, line, COLOR_TEXT);
+
+    // Acorde grande; los nombres largos (mMaj7, 7sus4) bajan de escala para entrar
+    if (st.chord.type == CHORD_NONE) snprintf(line, sizeof(line), "--");
+    else snprintf(line, sizeof(line), "%s%s", ROOT_NAMES[st.chord.root % 12], chordTypeDef(st.chord.type).name);
+    int scale = strlen(line) <= 6 ? 3 : 2;
+    drawText(next, 4, 48, line, COLOR_CHORD, scale);
+
+    if (st.bpm > 0) snprintf(line, sizeof(line), "%d BPM", st.bpm);
+    else snprintf(line, sizeof(line), "--- BPM");
+    drawText(next, 4, 88, line, COLOR_TEXT, 2);
+    drawText(next, 4, 112, st.playing ? "PLAY" : "STOP", st.playing ? COLOR_PLAY : COLOR_STOP, 2);
+
+    static const struct { const char* label; int channel; } SLOTS[] = { { "Upper", 0 }, { "Lower", 1 }, { "Lead", 3 } };
+    int y = 140;
+    for (const auto& slot : SLOTS) {
+        short id = sounds[slot.channel];
+        if (id >= 0) snprintf(line, sizeof(line), "%-6s%d", slot.label, id);
+        else snprintf(line, sizeof(line), "%-6s-", slot.label);
+        drawText(next, 4, y, line, COLOR_DIM);
+        y += 12;
+    }
+}
+
+// Agrupa filas consecutivas que cambiaron en un rectángulo con el rango x que cubre a todas
+void PanelDisplay::pushDirty() {
+    unsigned long frameRects = 0;
+    int top = -1, x0 = PANEL_W, x1 = -1;
+    for (int y = 0; y <= PANEL_H; y++) {
+        int first = -1, last = -1;
+        if (y < PANEL_H) {
+            const uint16_t* a = next + y * PANEL_W;
+            const uint16_t* b = shown + y * PANEL_W;
+            if (firstFrame || memcmp(a, b, PANEL_W * sizeof(uint16_t)) != 0) {
+                first = 0;
+                last = PANEL_W - 1;
+                if (!firstFrame) {
+                    while (a[first] == b[first]) first++;
+                    while (a[last] == b[last]) last--;
+                }
+            }
+        }
+        if (first >= 0) {
+            if (top < 0) top = y;
+            if (first < x0) x0 = first;
+            if (last > x1) x1 = last;
+            continue;
+        }
+        if (top >= 0) {
+            DisplayRect r = { x0, top, x1 - x0 + 1, y - top };
+            sink->pushRect(next, r);
+            for (int ry = r.y; ry < r.y + r.h; ry++)
+                memcpy(shown + ry * PANEL_W + r.x, next + ry * PANEL_W + r.x, r.w * sizeof(uint16_t));
+            frameRects++;
+            pixels.fetch_add((unsigned long)r.w * r.h, std::memory_order_relaxed);
+            top = -1; x0 = PANEL_W; x1 = -1;
+        }
+    }
+    firstFrame = false;
+    if (frameRects == 0) return;
+    rects.fetch_add(frameRects, std::memory_order_relaxed);
+    frames.fetch_add(1, std::memory_order_relaxed);
+    sink->endFrame(shown);
+}
+
+// --- HILO DE LA PANTALLA ---
+void PanelDisplay::run() {
+    // Más nice que todo lo demás: si la CPU no alcanza, el que espera es el panel
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 10);
+
+    unsigned lastVersion = ~0u;
+    short lastSounds[16];
+    for (short& s : lastSounds) s = -2;
+
+    while (running.load(std::memory_order_relaxed)) {
+        unsigned version = seq->panelVersion();
+        short sounds[16];
+        for (int ch = 0; ch < 16; ch++) sounds[ch] = (short)selectedSound(ch);
+
+        if (version != lastVersion || memcmp(sounds, lastSounds, sizeof(sounds)) != 0) {
+            PanelState st = seq->panelState();
+            render(st, sounds);
+            pushDirty();
+            lastVersion = version;
+            memcpy(lastSounds, sounds, sizeof(sounds));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(periodMs));
+    }
+}
@@ -8,16 +8,30 @@
 #include <algorithm>
 #include <RtMidi.h>
 #include <mutex> // <--- NECESARIO PARA PROTEGER MEMORIA
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <functional>
+#include <semaphore.h>
+#include "lockfree.h"
 
 // --- CONFIGURACIÓN DE PUERTOS Y CANALES ---
 const std::string PORT_MAPLE = "Maple";
 const std::string PORT_KORG = "nanoKONTROL";
 const std::string PORT_FLUID = "FLUID Synth";
+const std::string CACHE_FILE = "electone.cache"; // Sonidos y estilos compilados (se regenera solo)
 
 const int CHAN_INPUT_ACOMP = 1;
 const int CHAN_OUT_DRUMS   = 9;
 const int CHAN_OUT_ACOMP   = 4;
 
+// ¿El backend acepta varios mensajes en un solo sendMessage? (make MIDI_BATCH=1)
+#ifdef ELECTONE_MIDI_BATCH
+const bool MIDI_BATCHED = true;
+#else
+const bool MIDI_BATCHED = false;
+#endif
+
 // --- ESTRUCTURAS DE DATOS ---
 struct SoundPatch {
     int bank = 0;
@@ -25,59 +39,592 @@ struct SoundPatch {
     bool portamento = false;
     int portamentoTime = 0;
 };
-extern std::map<int, SoundPatch> generalSoundsDB;
+extern std::map<int, SoundPatch> generalSoundsDB; // Solo para carga (loadInstrumentDB)
 extern std::map<int, SoundPatch> leadSoundsDB;
 
+// Banco de sonidos publicado: los callbacks leen una instantánea inmutable y el
+// recargador publica una nueva sin que nadie vea un map a medio armar.
+struct SoundBank {
+    std::map<int, SoundPatch> general;
+    std::map<int, SoundPatch> lead;
+};
+// Lectura del banco vigente: mientras viva, ese banco no se libera. Sin locks ni deletes,
+// así sirve en los callbacks SCHED_FIFO.
+class SoundsRef {
+public:
+    SoundsRef();
+    ~SoundsRef();
+    SoundsRef(const SoundsRef&) = delete;
+    SoundsRef& operator=(const SoundsRef&) = delete;
+    const SoundBank* operator->() const { return bank; }
+
+private:
+    const SoundBank* bank;
+};
+inline SoundsRef currentSounds() { return SoundsRef(); }
+void publishSounds(std::map<int, SoundPatch> general, std::map<int, SoundPatch> lead);
+void freeRetiredSounds(); // Solo en el loop principal: libera los bancos reemplazados
+
 struct DrumPattern {
     std::map<int, std::vector<int>> tracks;
+    std::map<int, int> resolution; // Remate propio del fill (nota -> velocidad)
 };
 struct DrumStyle {
     int steps = 16;
+    int gate = 6;     // Duración de cada golpe en ticks (6 = una semi)
+    int swing = 0;    // Ticks de atraso de las semis impares (0..5), también para el acomp
+    int humanize = 0; // +- velocidad al azar en cada nota
     std::map<int, DrumPattern> variations;
     std::map<int, DrumPattern> fills;
     std::map<int, int> resolution;
 };
-struct AcompPattern {
+struct AcompPart {
+    int channel = CHAN_OUT_ACOMP;
     int program = 0;
     std::string mode = "chord";
     int velocity = 100;
     int steps = 16;
+    int octave = 3; // Solo mode 'degree': octava de la raíz (C3 = 48)
+    bool voiceLead = false;
+    int gate = 6; // Ticks que dura cada nota (un -1 en el patrón la liga al paso siguiente)
     std::vector<int> pattern;
 };
+// Un patrón son varias partes que suenan a la vez (bajo, comping, arpegio...), cada una
+// en su canal. La forma corta del YAML es una sola parte en CHAN_OUT_ACOMP.
+struct AcompPattern {
+    std::vector<AcompPart> parts;
+};
 struct AcompStyle {
     std::map<int, AcompPattern> patterns;
 };
 
+// --- TABLAS COMPILADAS (se arman al cargar, el clock solo las indexa) ---
+const int MAX_GATE_TICKS = 256 * 6; // Una nota ligada no dura más que el patrón más largo
+
+struct StepEvent {
+    unsigned char note;
+    unsigned char velocity;
+    unsigned short gate; // Ticks hasta el note off (ligaduras ya sumadas)
+};
+// Patrón aplanado: los eventos del paso s son events[offsets[s]] .. events[offsets[s+1] - 1]
+struct CompiledPattern {
+    int steps = 0; // 0 = no existe
+    std::vector<unsigned short> offsets;
+    std::vector<StepEvent> events;
+};
+struct CompiledDrumStyle {
+    bool valid = false;
+    int steps = 16;
+    unsigned char swing = 0;
+    unsigned char humanize = 0;
+    std::vector<CompiledPattern> variations;  // Índice = id de variación
+    std::vector<CompiledPattern> fills;       // Índice = id de fill
+    std::vector<CompiledPattern> resolutions; // Índice = id de fill (1 paso)
+};
+
+// Degree: cada paso es un grado del acorde reconocido (1, 3, 5, 7, 8 = octava, 9...)
+enum class AcompMode : unsigned char { Chord, ArpOnce, ArpLoop, Degree };
+const int MAX_ACOMP_PARTS = 8;
+const int MAX_ACOMP_STEPS = 1024; // Partes de distinto largo se despliegan hasta el mcm
+struct CompiledAcompPart {
+    AcompMode mode = AcompMode::Chord;
+    unsigned char channel = CHAN_OUT_ACOMP;
+    unsigned char program = 0;
+    unsigned char velocity = 100;
+    int baseNote = 48;      // Degree: dónde cae la raíz C (octave: 3 -> 48)
+    bool voiceLead = false; // Elegir la inversión más cercana al voicing anterior
+};
+struct AcompEvent {
+    unsigned char part;
+    unsigned char value; // n = nota n del acorde o grado n
+    unsigned short gate; // Ticks, con las ligaduras ya sumadas
+};
+// Todas las partes mezcladas en un solo flujo: los golpes del paso s son
+// events[offsets[s]] .. events[offsets[s+1] - 1], ordenados por parte
+struct CompiledAcompPattern {
+    bool valid = false;
+    int steps = 16;
+    std::vector<CompiledAcompPart> parts;
+    std::vector<unsigned short> offsets;
+    std::vector<AcompEvent> events;
+};
+struct CompiledAcompStyle {
+    bool valid = false;
+    std::vector<CompiledAcompPattern> patterns; // Índice = id de patrón
+};
+
+// --- DESTINOS DE SALIDA ---
+// Reciben bytes MIDI ya armados. delayNs > 0 pide que suenen en el futuro,
+// solo si el destino sabe agendar (canSchedule); si no, se ignora.
+class MidiSink {
+public:
+    virtual ~MidiSink() {}
+    virtual void send(const unsigned char* data, size_t size, long long delayNs = 0) = 0;
+    virtual bool acceptsStream() const { return false; } // ¿Varios mensajes en un solo send?
+    virtual bool canSchedule() const { return false; }
+    virtual void cancelScheduled() {}                    // Descarta lo agendado y no enviado
+};
+
+// Salida directa por RtMidi (puerto ALSA de FluidSynth o puerto virtual)
+class RtMidiSink : public MidiSink {
+public:
+    explicit RtMidiSink(RtMidiOut* port) : port(port) {}
+    void send(const unsigned char* data, size_t size, long long delayNs = 0) override { port->sendMessage(data, size); }
+    bool acceptsStream() const override { return MIDI_BATCHED; }
+
+private:
+    RtMidiOut* port;
+};
+
+#ifdef ELECTONE_WITH_ALSA_SEQ
+// Salida por una cola del secuenciador ALSA: los eventos llevan timestamp y el kernel
+// los despacha a tiempo, aunque nuestro proceso se demore (make ALSA_SEQ=1).
+// Se conecta sola al puerto cuyo nombre contiene 'dest'; si no lo encuentra queda
+// abierta para conectarla a mano (aconnect, o aseqdump para probar sin FluidSynth).
+struct AlsaSeqState;
+class AlsaSeqSink : public MidiSink {
+public:
+    explicit AlsaSeqSink(const std::string& dest);
+    ~AlsaSeqSink();
+
+    bool ok() const { return state != nullptr; }
+    void send(const unsigned char* data, size_t size, long long delayNs = 0) override;
+    bool acceptsStream() const override { return true; }
+    bool canSchedule() const override { return true; }
+    void cancelScheduled() override;
+
+private:
+    AlsaSeqState* state = nullptr;
+};
+#endif
+
+#ifdef ELECTONE_WITH_FLUIDSYNTH
+// FluidSynth dentro del proceso (make FLUIDSYNTH=1): sin ALSA seq ni proceso aparte.
+// El audio lo pide nuestro propio callback con el tamaño de período configurado.
+struct FluidConfig {
+    std::string soundfont;
+    std::string audioDevice = "plughw:3,0"; // Igual que start-synth.sh
+    int periodSize = 64;                    // Frames por callback de audio
+    int periods = 2;
+    double gain = 1.5;
+    double sampleRate = 44100;
+    std::string renderFile; // Si no está vacío: sin placa de sonido, el audio va a este WAV
+};
+
+struct FluidState;
+class FluidSynthSink : public MidiSink {
+public:
+    explicit FluidSynthSink(const FluidConfig& cfg);
+    ~FluidSynthSink();
+
+    bool ok() const { return state != nullptr; }
+    void send(const unsigned char* data, size_t size, long long delayNs = 0) override;
+    bool acceptsStream() const override { return true; }
+
+    // Solo con renderFile: avanza el audio 'ns' nanosegundos (render offline, sin esperar)
+    void advance(long long ns);
+    // Solo con renderFile: un hilo propio hace de placa de sonido a ritmo de tiempo real
+    void startRealtimeRender();
+
+private:
+    FluidState* state = nullptr;
+};
+#endif
+
+// --- SALIDA MIDI SIN ALOCACIONES ---
+// Junta los mensajes de un paso en un buffer fijo y los manda todos juntos en flush().
+// Si el destino acepta streams va un solo send con running status (RtMidi >= 5 sobre ALSA
+// parte el stream en eventos); si no, un send por mensaje, igual sin tocar el heap.
+class MidiOutBuffer {
+public:
+    explicit MidiOutBuffer(MidiSink* sink = nullptr);
+
+    void setSink(MidiSink* s);
+    void add(unsigned char status, unsigned char d1);
+    void add(unsigned char status, unsigned char d1, unsigned char d2);
+    void flush(long long delayNs = 0);
+
+    unsigned long messageCount() const { return messages; }
+    unsigned long sendCount() const { return sends; }
+
+private:
+    static const size_t CAPACITY = 512;
+    static const size_t MAX_MESSAGES = CAPACITY / 2;
+
+    MidiSink* sink;
+    bool batched;
+    unsigned char buf[CAPACITY];
+    size_t len = 0;
+    unsigned short starts[MAX_MESSAGES]; // Inicio de cada mensaje (modo no batched)
+    size_t count = 0;
+    unsigned char lastStatus = 0;        // Para running status
+
+    unsigned long messages = 0;
+    unsigned long sends = 0;
+
+    void reserve(size_t bytes);
+    void putStatus(unsigned char status);
+};
+
+// --- CONTADOR DE ALOCACIONES (solo con ALLOC_DEBUG=1) ---
+// Devuelve las alocaciones en el heap desde el arranque, o 0 si el contador no está compilado.
+unsigned long heapAllocCount();
+
+struct OutputStats {
+    unsigned long messages;  // Mensajes MIDI generados por el secuenciador
+    unsigned long sends;     // Llamadas a sendMessage
+    unsigned long maxStepAllocs; // Peor cantidad de alocaciones en un paso (0 = ninguna)
+};
+
+// --- INSTRUMENTACIÓN (latencia y jitter) ---
+// Reloj monotónico en nanosegundos
+long long monoNowNs();
+
+// Histograma logarítmico sin locks: 4 buckets por octava (~20% de resolución) desde 4 ns hasta ~1 s (lo mayor cae en el último).
+// record() es un par de fetch_add, se puede llamar desde cualquier hilo MIDI.
+class LatencyHistogram {
+public:
+    explicit LatencyHistogram(const char* name) : name(name) {}
+    void record(long long ns);
+    void dump(std::ostream& os) const;
+    void reset();
+
+private:
+    static const int BUCKETS = 112;
+    const char* name;
+    std::atomic<unsigned long> buckets[BUCKETS] = {};
+    std::atomic<unsigned long> count{0};
+    std::atomic<unsigned long long> sumNs{0};
+    std::atomic<long long> maxNs{0};
+};
+
+struct Metrics {
+    LatencyHistogram callbackLatency{"Latencia callback -> sendMessage"};
+    LatencyHistogram clockInterval{"Intervalo entre clocks (llegada)"};
+    LatencyHistogram clockDelta{"Intervalo entre clocks (deltatime RtMidi)"};
+    LatencyHistogram clockPhaseError{"Error de fase del clock (PLL enganchado)"};
+    LatencyHistogram onClockTime{"Duración de onClock"};
+    LatencyHistogram audioCallback{"Duración callback de audio"};
+};
+extern Metrics metrics;
+
+// Marca la entrada a un callback en este hilo; el primer envío posterior registra la latencia
+struct CallbackTimer {
+    CallbackTimer();
+    ~CallbackTimer();
+};
+void markOutputSent();
+// Con el reparto el envío real es en otro hilo: el callback entrega su marca con el mensaje
+long long takeCallbackEntry(); // Y deja de medir en este hilo (0 = no hay)
+void recordCallbackLatency(long long entryNs);
+void dumpMetrics(std::ostream& os);
+
+// --- TIEMPO REAL (--realtime [cpu], opcional) ---
+// setupRealtime: mlockall y prefault del hilo principal, antes de crear hilos.
+// Los hilos de callback los crea RtMidi, así que cada uno se configura solo la primera
+// vez que entra (enterRealtimeThread): SCHED_FIFO, afinidad a 'cpu' y prefault de su pila.
+struct RealtimeConfig {
+    bool enabled = false;
+    int priority = 70; // SCHED_FIFO 1..99 (FluidSynth suele usar 60 para el audio)
+    int cpu = -1;      // -1 = sin fijar
+};
+bool setupRealtime(const RealtimeConfig& cfg);
+void enterRealtimeThread(const char* name);
+// Fallos de página y cambios de contexto involuntarios de cada hilo desde que entró
+void dumpRealtimeStats(std::ostream& os);
+
+// --- CONJUNTOS DE NOTAS ---
+// 128 bits = todas las notas MIDI de un canal. Alta, baja y consulta son O(1) y recorrer
+// en orden ascendente salta de a palabras, sin ordenar nada.
+struct NoteSet {
+    uint64_t w[2] = { 0, 0 };
+
+    bool test(int n) const { return (w[n >> 6] >> (n & 63)) & 1; }
+    void set(int n) { w[n >> 6] |= 1ULL << (n & 63); }
+    void reset(int n) { w[n >> 6] &= ~(1ULL << (n & 63)); }
+    void clear() { w[0] = w[1] = 0; }
+    bool empty() const { return (w[0] | w[1]) == 0; }
+    int count() const { return __builtin_popcountll(w[0]) + __builtin_popcountll(w[1]); }
+    int highest() const { return w[1] ? 127 - __builtin_clzll(w[1]) : (w[0] ? 63 - __builtin_clzll(w[0]) : -1); }
+    int lowest() const { return w[0] ? __builtin_ctzll(w[0]) : (w[1] ? 64 + __builtin_ctzll(w[1]) : -1); }
+
+    template <typename F>
+    void forEach(F f) const {
+        for (int i = 0; i < 2; i++)
+            for (uint64_t b = w[i]; b; b &= b - 1) f(i * 64 + __builtin_ctzll(b));
+    }
+};
+
+// Lo que el motor dejó sonando, por canal: cada note on que sale se anota y cada note off
+// se descuenta, así el apagado es exacto aunque se corte un fill o cambie el estilo
+struct NoteLedger {
+    NoteSet channel[16];
+};
+
+// --- RUEDA DE TIEMPOS ---
+// Un balde por tick (24 ppqn) con los eventos que caen ahí, en listas enlazadas por índice
+// sobre un pool fijo: agendar y disparar son O(1) por evento, sin recorrer nada ni alocar.
+// Los note off van al principio del balde para que un re-ataque en el mismo tick no se corte.
+struct WheelEvent {
+    unsigned char channel;
+    unsigned char note;
+    unsigned char velocity; // 0 = note off
+    unsigned short gate;    // Solo note on: ticks hasta su note off
+    unsigned short next;
+};
+
+class TimerWheel {
+public:
+    static const int TICKS = 2048; // Horizonte: más que cualquier gate + un paso de lookahead
+    static const int POOL = 4096;
+
+    TimerWheel() { clear(); }
+
+    void clear() {
+        for (int i = 0; i < TICKS; i++) head[i] = tail[i] = NIL;
+        for (int i = 0; i < POOL; i++) pool[i].next = (unsigned short)(i + 1 < POOL ? i + 1 : NIL);
+        freeList = 0;
+        used = 0;
+    }
+
+    int available() const { return POOL - used; }
+
+    bool schedule(long tick, const WheelEvent& ev) {
+        if (freeList == NIL) return false;
+        unsigned short i = freeList;
+        freeList = pool[i].next;
+        used++;
+        pool[i] = ev;
+        int b = tick & (TICKS - 1);
+        if (ev.velocity == 0) { // Note off: adelante
+            pool[i].next = head[b];
+            head[b] = i;
+            if (tail[b] == NIL) tail[b] = i;
+        } else {
+            pool[i].next = NIL;
+            if (tail[b] == NIL) head[b] = i; else pool[tail[b]].next = i;
+            tail[b] = i;
+        }
+        return true;
+    }
+
+    // Dispara y libera todo lo del balde de 'tick'
+    template <typename F>
+    void fire(long tick, F f) {
+        int b = tick & (TICKS - 1);
+        unsigned short i = head[b];
+        head[b] = tail[b] = NIL;
+        while (i != NIL) {
+            unsigned short next = pool[i].next;
+            f(pool[i]);
+            pool[i].next = freeList;
+            freeList = i;
+            used--;
+            i = next;
+        }
+    }
+
+private:
+    static const unsigned short NIL = 0xFFFF;
+    WheelEvent pool[POOL];
+    unsigned short head[TICKS];
+    unsigned short tail[TICKS];
+    unsigned short freeList;
+    int used;
+};
+
+// --- ACORDES ---
+// Fingered: la máscara de 12 bits de lo tocado y la nota más grave pasan por una tabla de 12 x 4096.
+// SingleFinger: una tecla = mayor; + negra a la izquierda = menor; + blanca = 7; ambas = m7.
+enum class ChordMode : unsigned char { Fingered, SingleFinger };
+enum ChordType : unsigned char {
+    CHORD_NONE, CHORD_MAJ, CHORD_MIN, CHORD_DOM7, CHORD_MIN7, CHORD_MAJ7, CHORD_DIM, CHORD_AUG,
+    CHORD_SUS4, CHORD_SUS2, CHORD_M7B5, CHORD_DIM7, CHORD_MINMAJ7, CHORD_MAJ6, CHORD_MIN6, CHORD_7SUS4,
+    CHORD_TYPES
+};
+struct ChordInfo {
+    unsigned char root; // Clase de altura 0..11 (0 = C)
+    ChordType type;
+};
+struct ChordTypeDef {
+    const char* name;
+    signed char degree[10]; // Semitonos sobre la raíz por grado (1..9); -1 = no lo tiene
+};
+ChordInfo recognizeChord(unsigned pitchClassMask, int bassPitchClass); // Bajo: la nota más grave tocada
+ChordInfo singleFingerChord(const NoteSet& held);
+const ChordTypeDef& chordTypeDef(ChordType type);
+
+// --- BANCO DE ESTILOS (RCU) ---
+// Inmutable una vez publicado. El hilo del clock lo adopta al empezar un compás y
+// devuelve el anterior por una cola para que lo libere quien publica, nunca el clock.
+struct StyleBank {
+    std::vector<CompiledDrumStyle> drums;   // Índice = id de estilo (los ids llegan por CC, 0..127)
+    std::vector<CompiledAcompStyle> acomps;
+};
+
+// --- SEGUIMIENTO DEL CLOCK ENTRANTE (PLL) ---
+// Filtro de segundo orden sobre la llegada de cada 0xF8: estima período y fase, así el
+// lookahead agenda contra el tiempo filtrado y no contra el jitter de USB de cada tick.
+// Sin enganche (arranque, después de un stop o de un salto de tempo) sigue un promedio
+// móvil del intervalo y se engancha tras varios intervalos parecidos seguidos.
+struct ClockEstimate {
+    double periodNs;      // 0 = todavía sin tempo
+    long long lastTickNs; // Último tick, filtrado
+    long long nextTickNs; // Predicción del próximo
+    long long nextBarNs;  // Predicción del próximo comienzo de compás (0 = transporte parado)
+    bool locked;
+};
+
+struct ClockPllStats {
+    unsigned locks;
+    unsigned stops; // Desenganches por falta de ticks
+    unsigned jumps; // Desenganches por cambio brusco de tempo
+    double maxPhaseErrorUs; // Peor error de fase enganchado (lo que el filtro absorbió)
+};
+
+class ClockPll {
+public:
+    // Hilo del clock, un llamado por 0xF8 con su tiempo de llegada
+    void onTick(long long now);
+
+    // Tiempo previsto 'ahead' ticks después del último (0 = el último, ya filtrado)
+    long long predict(long ahead) const { return phaseNs + (long long)(ahead * periodNs); }
+    double period() const { return periodNs; }
+    bool locked() const { return isLocked; }
+    ClockPllStats stats() const;
+
+private:
+    static constexpr double ALPHA = 0.2;  // Corrección de fase por tick
+    static constexpr double BETA = 0.01;  // Corrección de período por tick
+    static const int LOCK_INTERVALS = 8;  // Intervalos seguidos dentro de +-12.5% para engancharse
+    static const int JUMP_TICKS = 3;      // Errores de fase > 1/4 de período seguidos para soltarse
+
+    double periodNs = 0;
+    long long phaseNs = 0; // Tiempo filtrado del último tick
+    long long lastRawNs = 0;
+    bool isLocked = false;
+    int goodIntervals = 0;
+    int badTicks = 0;
+
+    std::atomic<unsigned> locks{0};
+    std::atomic<unsigned> stops{0};
+    std::atomic<unsigned> jumps{0};
+    std::atomic<long long> maxErrorNs{0};
+
+    void unlock(long long now);
+};
+
+// --- COMANDOS DE CONTROL (callbacks -> hilo del clock) ---
+struct ControlCmd {
+    enum Type : unsigned char { Style, Var, Fill, AcompPattern, Octave, NoteOn, NoteOff, ChordMode };
+    Type type;
+    int value;
+};
+const size_t CONTROL_QUEUE_SIZE = 256;
+
+struct ControlStats {
+    unsigned highWater; // Máxima profundidad vista en la cola
+    unsigned dropped;   // Comandos perdidos por cola llena
+};
+
+// Registración ya resuelta contra el banco de sonidos: lo que el secuenciador manda en el
+// compás, sin maps ni strings. -1 = no tocar.
+struct ChannelTarget {
+    signed char bank = -1, program = -1, portamento = -1, portamentoTime = -1, volume = -1;
+};
+struct CompiledRegistration {
+    ChannelTarget channels[16];
+    short style = -1, var = -1, acompPattern = -1;
+    bool setOctave = false;
+    signed char octave = 0;
+};
+
+// Último valor mandado a cada canal (-1 = desconocido), compartido por todos los que
+// mandan patches o CCs: así el recall sabe qué ya está. Atómicos relajados: si dos hilos
+// tocan el mismo canal a la vez, lo peor es un mensaje de más.
+ChannelTarget patchTarget(const SoundPatch& patch);
+void noteChannelSent(int channel, const ChannelTarget& t);
+void noteControlSent(int channel, int cc, int value); // Solo importan 0, 5, 7 y 65
+ChannelTarget channelSent(int channel);
+void forgetChannelsSent(); // Salida nueva (un archivo de render): no se sabe nada mandado
+// Agrega a buf solo lo de t que difiere de lo ya mandado; devuelve los mensajes agregados
+int addChannelDelta(MidiOutBuffer& buf, int channel, const ChannelTarget& t);
+
+// Lo que muestra el panel: el secuenciador lo publica por seqlock (nunca espera) y el
+// hilo de la pantalla lo lee cuando quiere
+struct PanelState {
+    short style, var, fill, acompPattern, octave;
+    short bpm; // Estimado del clock entrante (0 = sin clock todavía)
+    ChordInfo chord;
+    bool playing;
+};
+
 // --- CLASE SECUENCIADOR ---
 class Sequencer {
 public:
-    Sequencer(RtMidiOut* outPort);
+    Sequencer(MidiSink* outSink);
+
+    Sequencer(const Sequencer&) = delete;
+    Sequencer& operator=(const Sequencer&) = delete;
+    ~Sequencer();
 
-    // Carga (sin mutex porque es al inicio)
-    void setDrumDatabase(std::map<int, DrumStyle> db);
-    void setAcompDatabase(std::map<int, AcompStyle> db);
+    // Carga (cualquier hilo, en cualquier momento): si está sonando se adopta en el próximo compás
+    void publishDatabases(std::vector<CompiledDrumStyle> drums, std::vector<CompiledAcompStyle> acomps);
 
-    // MÉTODOS PÚBLICOS (TODOS NECESITAN PROTECCIÓN)
+    // TRANSPORTE (hilo del clock, con mutex)
     void onClock();
     void onStart();
     void onStop();
-    void onNoteInput(int note, bool on);
 
+    // CONTROLES (cualquier hilo): solo encolan, nunca bloquean.
+    // El hilo del clock los aplica al principio del siguiente onClock.
+    void onNoteInput(int note, bool on);
     void setStyle(int style);
     void setVar(int var);
     void setFill(int fill);
     void setAcompPattern(int pat);
     void changeOctave(int direction);
+    void setChordMode(int mode); // 0 = fingered, 1 = single finger
+    // Registración: parado se aplica ya; sonando, al empezar el próximo compás, en un
+    // solo envío con las notas de ese paso
+    void recallRegistration(const CompiledRegistration& reg);
+
+    ControlStats controlStats() const;
+    OutputStats outputStats() const;
+    PanelState panelState() const { return panel.load(); }
+    unsigned panelVersion() const { return panel.version(); }
+    // Tempo y fase del clock entrante (cualquier hilo)
+    ClockEstimate clockEstimate() const { return clockState.load(); }
+    ClockPllStats clockStats() const { return pll.stats(); }
+
+    // Lookahead: cada paso se calcula un paso antes y se agenda con timestamp
+    // (solo si el destino sabe agendar). El tempo lo sigue marcando el clock entrante.
+    bool setLookahead(bool enabled);
 
 private:
-    std::mutex mtx; // <--- EL SEMÁFORO
-    RtMidiOut* midiOut;
+    std::mutex mtx; // <--- EL SEMÁFORO (solo transporte y drenado)
+    MidiSink* sink;
+    MidiOutBuffer out;
+    bool lookahead = false;
+    ClockPll pll; // Período y fase del clock (solo el hilo del clock)
+    SeqLock<ClockEstimate> clockState;
+    std::atomic<unsigned long> maxStepAllocs{0};
 
-    std::map<int, DrumStyle> drumDB;
-    std::map<int, AcompStyle> acompDB;
+    MpscQueue<ControlCmd, CONTROL_QUEUE_SIZE> controlQueue;
+    std::atomic<unsigned> queueHighWater{0};
+    std::atomic<unsigned> queueDropped{0};
+    MpscQueue<CompiledRegistration, 4> pendingRegs; // Si se piden varias antes del compás, gana la última
+    SeqLock<PanelState> panel;
+    PanelState lastPanel = {}; // Último publicado: solo se escribe el seqlock si cambió
 
-    bool isPlaying = false;
+    StyleBank* bank;                           // Solo lo toca el hilo del clock (con mtx)
+    std::atomic<StyleBank*> pendingBank{nullptr}; // Publicado y todavía no adoptado
+    MpscQueue<StyleBank*, 8> retiredBanks;        // Adoptados y reemplazados, para liberar
+
+    std::atomic<bool> isPlaying{false};
     long tickCounter = 0;
+    long stepTick = 0;      // Tick del paso que se está calculando (adelantado con lookahead)
+    long nextStepTick = 0;  // Primer paso todavía no calculado
     int stepIndex = 0;
 
     int currentStyle = 0;
@@ -87,21 +634,501 @@ private:
     int currentAcompPat = 0;
     int octaveShift = 0;
 
-    std::vector<int> heldNotes;
-    std::vector<int> lastDrumNotes;
-    std::vector<int> lastAcompNotes;
+    NoteSet heldNotes;
+    // Acorde reconocido: se recalcula solo cuando cambia heldNotes, nunca en el clock
+    ChordMode chordMode = ChordMode::Fingered;
+    ChordInfo chord = { 0, CHORD_NONE };
+    std::vector<int> chordNotes; // Lo que tocan chord/arp (en fingered, lo tocado tal cual)
+    // Voicing cacheado por parte: se arma en el primer paso después de un cambio de acorde,
+    // octava, patrón o banco; los pasos siguientes solo leen estas tablas
+    struct PartVoicing {
+        std::vector<unsigned char> voicing;  // Notas finales (octava + clamp + voice-leading)
+        std::vector<unsigned char> arpCycle; // arp-loop ya desplegado ida y vuelta
+        std::vector<int> prevVoicing;        // Último voicing sin octava, referencia del voice-leading
+        unsigned char degreeNotes[10] = {};  // mode degree: nota final por grado (0 = sin acorde)
+    };
+    bool voicingDirty = true;
+    PartVoicing partVoicing[MAX_ACOMP_PARTS];
+    unsigned short outChannels = (1 << CHAN_OUT_DRUMS) | (1 << CHAN_OUT_ACOMP); // Donde puede haber algo sonando
+    NoteLedger sounding; // Notas prendidas por el secuenciador (las apaga la rueda o panic)
+    TimerWheel wheel;    // Note on/off agendados por tick (gate, ligaduras, swing)
+    long firedTick = -1; // Último balde disparado
+    long noteOnTick[16][128];  // Tick del último ataque de cada nota
+    long noteOffTick[16][128]; // Tick en que le toca el note off vigente (los anteriores se ignoran)
+    unsigned rng = 0x9E3779B9; // humanize (xorshift, sin locks ni alocaciones)
 
     // Métodos privados (se llaman desde dentro, no llevan mutex propio)
-    void playDrumStep(const DrumStyle& style);
-    void playAcompStep(const AcompStyle& style);
+    void postCommand(ControlCmd::Type type, int value);
+    void drainIfStopped();
+    void updateChord();
+    void buildVoicing(const CompiledAcompPart& part, PartVoicing& pv);
+    void voiceLead(int* notes, int count, const std::vector<int>& prevVoicing);
+    void drainCommands();
+    void applyCommand(const ControlCmd& cmd);
+    void adoptPendingBank();
+    void applyPendingRegistration();
+    void freeRetiredBanks();
+    void runStep(long tick, long long delayNs);
+    void playDrumStep(const CompiledDrumStyle& style, int offset);
+    void playAcompStep(const CompiledAcompPattern& pattern, int offset, int humanize);
+    void scheduleNote(int channel, int note, int velocity, int gate, int offset, int humanize);
+    void fireTick(long tick);
+    const CompiledAcompPattern* currentAcomp() const;
     void sendNote(int channel, int note, int velocity);
-    void sendProgramChange(int channel, int program);
+    void sendAcompPrograms();
+    void allNotesOff();
+    void releaseChannel(int channel);
     void panic();
+    void publishPanel();
+    void publishClock();
+    int stepsPerBar() const;
+};
+
+// --- PANTALLA DEL PANEL (120x180 SPI) ---
+// Hilo propio de baja prioridad: lee la instantánea del secuenciador y los sonidos
+// elegidos, dibuja en un framebuffer RGB565 y manda al destino solo los rectángulos que
+// cambiaron. Los hilos MIDI nunca lo esperan.
+const int PANEL_W = 120;
+const int PANEL_H = 180;
+
+struct DisplayRect {
+    int x, y, w, h;
 };
+class DisplaySink {
+public:
+    virtual ~DisplaySink() {}
+    // fb es el cuadro completo (PANEL_W x PANEL_H); solo r cambió
+    virtual void pushRect(const uint16_t* fb, const DisplayRect& r) = 0;
+    virtual void endFrame(const uint16_t* fb) {}
+};
+
+// Sin panel: cada cuadro terminado se escribe como PPM (pruebas, o ver el layout en la PC)
+class FileDisplaySink : public DisplaySink {
+public:
+    explicit FileDisplaySink(const std::string& path) : path(path) {}
+    void pushRect(const uint16_t* fb, const DisplayRect& r) override {}
+    void endFrame(const uint16_t* fb) override;
+
+private:
+    std::string path;
+};
+
+struct DisplayStats {
+    unsigned long frames; // Cuadros con algún cambio
+    unsigned long rects;
+    unsigned long pixels; // Píxeles mandados (contra PANEL_W * PANEL_H por cuadro sin dirty rects)
+};
+
+class PanelDisplay {
+public:
+    PanelDisplay(const Sequencer* seq, DisplaySink* sink, int periodMs = 50);
+    ~PanelDisplay();
+
+    void start();
+    void stop();
+    DisplayStats stats() const;
+
+private:
+    const Sequencer* seq;
+    DisplaySink* sink;
+    int periodMs;
+    std::thread worker;
+    std::atomic<bool> running{false};
+
+    uint16_t shown[PANEL_W * PANEL_H]; // Lo que ya tiene el panel
+    uint16_t next[PANEL_W * PANEL_H];  // Cuadro nuevo
+    bool firstFrame = true;
+
+    std::atomic<unsigned long> frames{0};
+    std::atomic<unsigned long> rects{0};
+    std::atomic<unsigned long> pixels{0};
+
+    void run();
+    void render(const PanelState& st, const short* sounds);
+    void pushDirty();
+};
+
+// --- CLOCK INTERNO (opcional, reemplaza al 0xF8 del Maple) ---
+const int PPQN = 24;
+
+struct ClockStats {
+    unsigned long ticks;
+    double meanJitterUs; // Desvío medio del período medido respecto del nominal
+    double maxJitterUs;  // Peor desvío de período
+    double maxLateUs;    // Peor atraso respecto del deadline absoluto
+};
+
+// Hilo propio que duerme hasta deadlines absolutos (CLOCK_MONOTONIC), así el error
+// de un tick no se acumula en el siguiente. Llama a Sequencer::onClock y reenvía
+// 0xFA / 0xF8 / 0xFC a la salida.
+class InternalClock {
+public:
+    InternalClock(Sequencer* seq, MidiSink* out, double bpm = 120.0);
+    ~InternalClock();
+
+    void start();
+    void stop();        // Espera al hilo e informa: no desde un callback
+    void requestStop(); // Desde callbacks: solo baja la bandera, el hilo sale solo
+    bool reap();        // Loop principal: si el hilo ya salió lo junta e informa
+    bool isRunning() const { return running.load(); }
+
+    void setBpm(double bpm);
+    double getBpm() const { return bpm.load(); }
+
+    ClockStats stats() const;
+
+private:
+    Sequencer* seq;
+    MidiSink* out;
+    std::thread worker;
+    std::mutex workerMtx; // start / stop / reap vienen de hilos distintos
+    std::atomic<bool> running{false};
+    std::atomic<bool> finished{false};
+    std::atomic<double> bpm;
+
+    // Estadísticas (escribe solo el hilo del clock)
+    std::atomic<unsigned long> ticks{0};
+    std::atomic<double> jitterSumUs{0};
+    std::atomic<double> maxJitterUs{0};
+    std::atomic<double> maxLateUs{0};
+
+    void run();
+    void report() const;
+    void sendRealtime(unsigned char status);
+};
+
+// --- CACHÉ BINARIO (sounds + ritmos + chords ya compilados) ---
+struct EngineData {
+    std::map<int, SoundPatch> generalSounds;
+    std::map<int, SoundPatch> leadSounds;
+    std::vector<CompiledDrumStyle> drums;
+    std::vector<CompiledAcompStyle> acomps;
+};
+// Carga desde el caché si coincide con el hash de los YAML; si no, parsea y compila los
+// YAML y regenera el caché. Con algún error en los YAML, d queda con lo que se pudo
+// compilar y el caché no se toca. Informa el tiempo de carga.
+enum class EngineLoad { Cache, Yaml, Error };
+EngineLoad loadEngineData(const std::string& soundsFile, const std::string& ritmosFile, const std::string& chordsFile,
+                    const std::string& cachePath, EngineData& d);
+
+// --- RECARGA EN CALIENTE (inotify) ---
+// files = {sounds, ritmos, chords} dentro de dir; onReload corre en el hilo del watcher,
+// solo si todo cargó sin errores (si no, queda el banco anterior).
+class BankWatcher {
+public:
+    BankWatcher(const std::string& dir, std::vector<std::string> files, std::function<void(EngineData&)> onReload);
+    ~BankWatcher();
+
+    bool start();
+    void stop();
+
+private:
+    std::string dir;
+    std::vector<std::string> files;
+    std::function<void(EngineData&)> onReload;
+    int fd = -1;
+    std::thread worker;
+    std::atomic<bool> running{false};
+
+    bool readEvents();
+    void run();
+};
+
+// --- STANDARD MIDI FILE ---
+struct SmfEvent {
+    unsigned long tick;
+    std::vector<unsigned char> data; // Un mensaje completo (los SysEx empiezan con F0)
+};
+struct SmfTrack {
+    std::string name;
+    std::vector<SmfEvent> events; // Ordenados por tick
+};
+bool writeSmf(const std::string& path, const std::vector<SmfTrack>& tracks, int division, double bpm);
+
+// --- GRABADOR DE TOMAS ---
+// Los callbacks y las salidas solo copian el mensaje con su timestamp a un anillo
+// prealocado (sin locks ni alocar). Un hilo de baja prioridad lo vacía y al cortar la
+// toma escribe un .mid de formato 1 con una pista por origen.
+enum RecSource { REC_MAPLE, REC_KORG, REC_SEQUENCER, REC_OUTPUT, REC_SOURCES };
+
+struct RecEvent {
+    long long timeNs;      // CLOCK_MONOTONIC en que suena (con el delay de lookahead ya sumado)
+    unsigned char source;  // RecSource, o REC_SOURCES = marca de inicio / fin de toma
+    unsigned char size;
+    unsigned char data[14]; // Los SysEx más largos no se graban (cuentan como descartados)
+};
+
+struct RecorderStats {
+    unsigned long events;   // Mensajes encolados
+    unsigned long overruns; // Anillo lleno: mensaje perdido
+    unsigned long skipped;  // Demasiado largos para RecEvent
+    unsigned long takes;    // Archivos escritos
+    bool recording;
+};
+
+class Recorder {
+public:
+    explicit Recorder(const std::string& dir);
+    ~Recorder();
+
+    void start(); // Hilo escritor
+    void stop();  // Corta la toma en curso (si hay) y la escribe
+
+    // Arranca o corta una toma; se puede llamar desde cualquier callback
+    void toggleTake();
+    bool isRecording() const { return recording.load(std::memory_order_relaxed); }
+
+    // Desde cualquier hilo; sin toma en curso es una sola lectura atómica.
+    // Acepta streams con varios mensajes y running status; ignora los de tiempo real (0xF8..)
+    void record(RecSource source, const unsigned char* data, size_t size, long long delayNs = 0);
+
+    RecorderStats stats() const;
+
+private:
+    static const size_t RING_SIZE = 8192;
+    static const int DIVISION = 500; // A 120 BPM: un tick = 1 ms
+
+    std::string dir;
+    MpscQueue<RecEvent, RING_SIZE> ring;
+    std::atomic<bool> recording{false};
+    std::atomic<bool> toggling{false};
+    std::thread worker;
+    std::atomic<bool> running{false};
+
+    std::atomic<unsigned long> events{0};
+    std::atomic<unsigned long> overruns{0};
+    std::atomic<unsigned long> skipped{0};
+    std::atomic<unsigned long> takes{0};
+
+    bool pushMark(bool begin);
+    void run();
+};
+
+// Envuelve un destino: lo que sale por él también va al grabador
+class RecordingSink : public MidiSink {
+public:
+    RecordingSink(MidiSink* inner, Recorder* rec, RecSource source) : inner(inner), rec(rec), source(source) {}
+    void send(const unsigned char* data, size_t size, long long delayNs = 0) override {
+        rec->record(source, data, size, delayNs);
+        inner->send(data, size, delayNs);
+    }
+    bool acceptsStream() const override { return inner->acceptsStream(); }
+    bool canSchedule() const override { return inner->canSchedule(); }
+    void cancelScheduled() override { inner->cancelScheduled(); }
+
+private:
+    MidiSink* inner;
+    Recorder* rec;
+    RecSource source;
+};
+
+// --- REPARTO A VARIOS DESTINOS ---
+// Cada destino tiene su cola sin locks y su hilo: quien manda (el clock con el mutex del
+// secuenciador tomado, un callback) solo encola. Si un puerto se traba, se llena su cola
+// y pierde mensajes él solo; el resto y el secuenciador siguen a tiempo.
+
+// Largo de un mensaje según su status (SysEx: hasta el F7 o lo que haya)
+size_t midiMessageLength(const unsigned char* p, size_t avail, unsigned char status);
+
+struct OutputFilter {
+    unsigned short channels = 0xFFFF; // Un bit por canal; los mensajes de sistema pasan siempre
+    int transpose = 0;                // Semitonos; no toca el canal de batería
+};
+
+struct OutEvent {
+    long long dueNs;        // 0 = ya; si no, CLOCK_MONOTONIC en que tiene que sonar
+    long long entryNs;      // Entrada al callback que lo mandó (takeCallbackEntry), o 0
+    unsigned char size;     // 0 = marca de cancelScheduled
+    unsigned char data[47]; // Los SysEx más largos no entran (cuentan como descartados)
+};
+
+struct OutputDestStats {
+    unsigned long messages; // Entregados al puerto
+    unsigned long dropped;  // Cola llena (los note on, ya con 3/4): el puerto no da abasto
+    unsigned long skipped;  // SysEx demasiado largos para OutEvent
+    unsigned highWater;     // Máxima profundidad vista en la cola
+    double maxSendUs;       // Peor send individual al puerto
+};
+
+class OutputDestination {
+public:
+    OutputDestination(const std::string& name, MidiSink* sink, const OutputFilter& filter = OutputFilter());
+    ~OutputDestination();
+
+    void start();
+    void stop(); // Manda lo que quedó en la cola y termina
+
+    // Desde cualquier hilo: separa el stream en mensajes, filtra, transpone y encola.
+    // entryNs va con el primer mensaje encolado; devuelve true si se usó
+    bool push(const unsigned char* data, size_t size, long long delayNs = 0, long long entryNs = 0);
+    void pushCancel(); // cancelScheduled en orden con lo ya encolado
+
+    const std::string& getName() const { return name; }
+    bool canSchedule() const { return sink->canSchedule(); }
+    OutputDestStats stats() const;
+
+private:
+    static const size_t QUEUE_SIZE = 1024;
+
+    std::string name;
+    MidiSink* sink;
+    OutputFilter filter;
+    MpscQueue<OutEvent, QUEUE_SIZE> queue;
+    sem_t wake; // Un post por evento: sem_post no entra al kernel si el hilo no duerme
+    std::thread worker;
+    std::atomic<bool> running{false};
+
+    std::atomic<unsigned long> messages{0};
+    std::atomic<unsigned long> dropped{0};
+    std::atomic<unsigned long> skipped{0};
+    std::atomic<unsigned> highWater{0};
+    std::atomic<long long> maxSendNs{0};
+
+    // Libreta de notas: note ons encolados sin su note off, y note offs que no entraron
+    // (el hilo los manda cuando la cola se vacía). Así la cola llena no deja notas colgadas.
+    std::atomic<unsigned char> held[16][128] = {};
+    std::atomic<uint64_t> owed[16][2] = {};
+    std::atomic<bool> anyOwed{false};
+
+    bool enqueue(const OutEvent& ev);
+    bool enqueueNote(const OutEvent& ev);
+    void sendOwed(MidiOutBuffer& buf);
+    void run();
+};
+
+// El MidiSink que ven el secuenciador y main: copia cada envío a todos sus destinos.
+// Dos repartidores pueden compartir destinos (la cola admite varios productores).
+class OutputFanout : public MidiSink {
+public:
+    void add(OutputDestination* d) { dests.push_back(d); } // Solo antes de mandar
+    // La latencia del callback se mide en el hilo del primer destino que lo manda de verdad
+    void send(const unsigned char* data, size_t size, long long delayNs = 0) override {
+        long long entry = takeCallbackEntry();
+        for (OutputDestination* d : dests) if (d->push(data, size, delayNs, entry)) entry = 0;
+    }
+    bool acceptsStream() const override { return true; }
+    // Con lookahead todos tienen que agendar; si no, alguno tocaría un paso antes
+    bool canSchedule() const override {
+        for (OutputDestination* d : dests) if (!d->canSchedule()) return false;
+        return !dests.empty();
+    }
+    void cancelScheduled() override { for (OutputDestination* d : dests) d->pushCancel(); }
+
+private:
+    std::vector<OutputDestination*> dests;
+};
+
+// --- RUTEO DE CONTROLES (routing.yaml) ---
+// Se compila al arrancar a una tabla [puerto][tipo de status][data1]: cada mensaje que
+// entra es un solo acceso indexado y un switch, sin strings ni maps.
+enum class RouteAction : unsigned char {
+    None, Forward, ControlOut, PatchGeneral, PatchLead,
+    Style, Var, Fill, AcompPattern, ChordMode, OctaveUp, OctaveDown,
+    MasterVolume, DumpMetrics, Shutdown, Tempo, ClockStart, ClockStop, Record,
+    Registration, RegistrationBank, RegistrationStore
+};
+struct Route {
+    RouteAction action = RouteAction::None;
+    unsigned char channel = 0; // Canal destino (cc, volume, patch)
+    unsigned char number = 0;  // CC destino (cc; volume = 7)
+    signed char value = -1;    // Valor fijo (botones del panel): la acción va con este y solo al apretar
+};
+enum RoutePort { ROUTE_MAPLE, ROUTE_KORG, ROUTE_PORTS };
+// SysEx del panel: F0 <header> <botón> [<valor>] F7. El header se compara sobre el buffer
+// recibido y el botón indexa la tabla, igual que un CC.
+struct SysexRoutes {
+    unsigned char header[16];
+    unsigned char headerLen = 0; // 0 = sin SysEx en este puerto
+    bool logUnknown = false;     // Imprimir los que no matchean (los imprime el loop principal)
+    Route buttons[128];
+};
+struct RoutingTable {
+    Route routes[ROUTE_PORTS][8][128]; // Tipo = (status >> 4) & 7: 0 note off, 1 note on, 3 cc, 4 program...
+    SysexRoutes sysex[ROUTE_PORTS];
+};
+bool loadRouting(const std::string& filename, RoutingTable& table);
+
+// --- REGISTRACIONES (registrations.yaml) ---
+// Bancos de memorias con sonidos, volúmenes, ritmo, variación, patrón y octava. Al
+// recuperar se resuelve contra el banco de sonidos vigente y el secuenciador manda solo
+// la diferencia con lo que ya suena. Guardar: botón 'registration-store' y después la memoria.
+const int REG_BANKS = 4;
+const int REG_MEMORIES = 8;
+
+struct Registration {
+    bool valid = false;
+    short sound[16];        // Id de sounds (lead: lead_sounds), -1 = no tocar
+    signed char volume[16]; // -1 = no tocar
+    short style = -1, var = -1, acompPattern = -1;
+    bool setOctave = false;
+    signed char octave = 0;
+    Registration() {
+        for (short& v : sound) v = -1;
+        for (signed char& v : volume) v = -1;
+    }
+};
+
+struct RegistrationStats {
+    unsigned long recalls;
+    unsigned long stores;
+    unsigned long sent;    // Mensajes mandados por recalls
+    unsigned long skipped; // Mensajes que no hizo falta mandar (ya estaban)
+};
+
+// Sonido elegido por canal (-1 = ninguno): lo anota el ruteo al aplicar un patch
+void noteSelectedSound(int channel, int sound);
+int selectedSound(int channel);
+
+class RegistrationMemory {
+public:
+    explicit RegistrationMemory(const std::string& path) : path(path) {}
+
+    bool load(); // Sin archivo: todas vacías
+    bool saveIfDirty(); // Desde el loop principal, nunca desde un callback
+
+    // Botones (cualquier callback)
+    void selectBank(int bank);   // 1..REG_BANKS
+    void armStore();             // La próxima memoria apretada se guarda en vez de recuperarse
+    void press(int memory, Sequencer* seq); // 1..REG_MEMORIES
+
+    RegistrationStats stats() const;
+
+private:
+    std::string path;
+    mutable std::mutex mtx; // Solo botones y el guardado; el clock nunca lo toma
+    Registration regs[REG_BANKS][REG_MEMORIES];
+    std::atomic<int> bank{0};
+    std::atomic<bool> storeArmed{false};
+    std::atomic<bool> dirty{false};
+    std::atomic<unsigned long> recalls{0};
+    std::atomic<unsigned long> stores{0};
+};
+
+// --- RENDER SIN TECLADO (electone_core render ...) ---
+int runRender(int argc, char** argv);
+
+// --- BENCH (electone_core bench ..., make bench) ---
+// Cargas sintéticas contra un destino que solo cuenta; cada resultado es una línea JSON
+// agregada al archivo de salida, para comparar entre commits en la misma Pi.
+int runBench(int argc, char** argv);
+
+// Globales y callbacks de main.cpp: el bench los arma sin puertos de entrada
+extern Sequencer* seq;
+extern MidiSink* outSink;
+extern MidiSink* clockSink;
+extern Recorder* recorder;
+extern RoutingTable routing;
+void mapleCallback(double deltatime, std::vector<unsigned char>* message, void* userData);
+void korgCallback(double deltatime, std::vector<unsigned char>* message, void* userData);
 
 // Funciones de carga
-std::map<int, DrumStyle> loadDrumStyles(const std::string& filename);
-std::map<int, AcompStyle> loadAcompStyles(const std::string& filename);
-void loadInstrumentDB(const std::string& filename);
+// Con un error de YAML devuelven lo leído hasta ahí y ponen *ok = false
+std::map<int, DrumStyle> loadDrumStyles(const std::string& filename, bool* ok = nullptr);
+std::map<int, AcompStyle> loadAcompStyles(const std::string& filename, bool* ok = nullptr);
+bool loadInstrumentDB(const std::string& filename); // false: error, las tablas quedan como estaban
+
+// Compilación a tablas planas (descarta con error los estilos mal formados; *ok = false si hubo alguno)
+std::vector<CompiledDrumStyle> compileDrumStyles(const std::map<int, DrumStyle>& db, bool* ok = nullptr);
+std::vector<CompiledAcompStyle> compileAcompStyles(const std::map<int, AcompStyle>& db, bool* ok = nullptr);
 
 #endif
@@ -0,0 +1,226 @@
+#include "electone.h"
+#include <cerrno>
+#include <cstring>
+
+static const size_t MAX_BATCH = 128; // Mensajes por send: entran holgados en un MidiOutBuffer
+
+// Mide cada send del puerto (MidiOutBuffer puede partir un flush en varios)
+class TimedSink : public MidiSink {
+public:
+    TimedSink(MidiSink* inner, std::atomic<long long>& maxNs) : inner(inner), maxNs(maxNs) {}
+    void send(const unsigned char* data, size_t size, long long delayNs = 0) override {
+        long long t0 = monoNowNs();
+        inner->send(data, size, delayNs);
+        long long took = monoNowNs() - t0;
+        if (took > maxNs.load(std::memory_order_relaxed)) maxNs.store(took, std::memory_order_relaxed);
+    }
+    bool acceptsStream() const override { return inner->acceptsStream(); }
+
+private:
+    MidiSink* inner;
+    std::atomic<long long>& maxNs;
+};
+
+// --- REPARTO A VARIOS DESTINOS ---
+OutputDestination::OutputDestination(const std::string& name, MidiSink* sink, const OutputFilter& filter)
+    : name(name), sink(sink), filter(filter) {
+    sem_init(&wake, 0, 0);
+}
+
+OutputDestination::~OutputDestination() {
+    stop();
+    sem_destroy(&wake);
+}
+
+void OutputDestination::start() {
+    if (running.exchange(true)) return;
+    worker = std::thread(&OutputDestination::run, this);
+}
+
+void OutputDestination::stop() {
+    if (!running.exchange(false)) return;
+    sem_post(&wake);
+    if (worker.joinable()) worker.join();
+}
+
+bool OutputDestination::enqueue(const OutEvent& ev) {
+    if (!queue.push(ev)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    atomicMax(highWater, (unsigned)queue.size());
+    sem_post(&wake);
+    return true;
+}
+
+// El último cuarto de la cola queda para note offs y lo demás: un note on perdido no deja
+// nada colgado en el sinte. Un note off sin su note on encolado no hace falta; uno que no
+// entra queda anotado y sale después.
+bool OutputDestination::enqueueNote(const OutEvent& ev) {
+    int ch = ev.data[0] & 0x0F, note = ev.data[1];
+    bool on = (ev.data[0] & 0xF0) == 0x90 && ev.data[2] > 0;
+    std::atomic<unsigned char>& h = held[ch][note];
+    if (on) {
+        if (queue.size() >= QUEUE_SIZE * 3 / 4 || !queue.push(ev)) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (h.load(std::memory_order_relaxed) < 255) h.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        if (h.load(std::memory_order_relaxed) == 0) return false;
+        h.fetch_sub(1, std::memory_order_relaxed);
+        if (!queue.push(ev)) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            owed[ch][note >> 6].fetch_or(1ULL << (note & 63), std::memory_order_relaxed);
+            anyOwed.store(true, std::memory_order_release);
+            return false;
+        }
+    }
+    atomicMax(highWater, (unsigned)queue.size());
+    sem_post(&wake);
+    return true;
+}
+
+// Solo con la cola vacía: lo anotado sale después de todo lo que ya estaba encolado
+void OutputDestination::sendOwed(MidiOutBuffer& buf) {
+    if (!anyOwed.exchange(false, std::memory_order_acquire)) return;
+    for (int ch = 0; ch < 16; ch++) {
+        for (int w = 0; w < 2; w++) {
+            uint64_t bits = owed[ch][w].exchange(0, std::memory_order_relaxed);
+            for (int b = 0; bits; b++, bits >>= 1) {
+                if (!(bits & 1)) continue;
+                buf.add(0x80 | ch, w * 64 + b, 0);
+                messages.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+    buf.flush();
+}
+
+bool OutputDestination::push(const unsigned char* data, size_t size, long long delayNs, long long entryNs) {
+    OutEvent ev;
+    ev.dueNs = delayNs > 0 ? monoNowNs() + delayNs : 0;
+    ev.entryNs = entryNs;
+
+    unsigned char status = 0;
+    size_t i = 0;
+    while (i < size) {
+        size_t len;
+        if (data[i] >= 0xF8) { // Tiempo real: puede venir en medio de otro mensaje
+            ev.size = 1;
+            ev.data[0] = data[i++];
+            if (enqueue(ev)) ev.entryNs = 0;
+            continue;
+        }
+        if (data[i] >= 0x80) {
+            status = data[i];
+            len = midiMessageLength(data + i, size - i, status);
+            if (i + len > size) break;
+            if (len > sizeof(ev.data)) { skipped.fetch_add(1, std::memory_order_relaxed); i += len; continue; }
+            ev.size = (unsigned char)len;
+            memcpy(ev.data, data + i, len);
+        } else {
+            if (status == 0 || status >= 0xF0) break; // Datos sueltos: el stream está roto
+            len = midiMessageLength(data + i, size - i, status) - 1; // Running status
+            if (i + len > size) break;
+            ev.size = (unsigned char)(len + 1);
+            ev.data[0] = status;
+            memcpy(ev.data + 1, data + i, len);
+        }
+        i += len;
+
+        if (status < 0xF0) {
+            int ch = status & 0x0F;
+            if (!(filter.channels & (1 << ch))) continue;
+            int type = status & 0xF0;
+            if (filter.transpose != 0 && ch != CHAN_OUT_DRUMS && (type == 0x80 || type == 0x90 || type == 0xA0)) {
+                int note = ev.data[1] + filter.transpose;
+                if (note < 0 || note > 127) continue; // El note off correspondiente también cae acá
+                ev.data[1] = (unsigned char)note;
+            }
+            if (type == 0x80 || type == 0x90) {
+                if (enqueueNote(ev)) ev.entryNs = 0;
+                continue;
+            }
+        }
+        if (enqueue(ev)) ev.entryNs = 0;
+    }
+    return entryNs != 0 && ev.entryNs == 0;
+}
+
+void OutputDestination::pushCancel() {
+    OutEvent ev;
+    ev.dueNs = 0;
+    ev.entryNs = 0;
+    ev.size = 0;
+    enqueue(ev);
+}
+
+OutputDestStats OutputDestination::stats() const {
+    return { messages.load(std::memory_order_relaxed), dropped.load(std::memory_order_relaxed),
+             skipped.load(std::memory_order_relaxed), highWater.load(std::memory_order_relaxed),
+             maxSendNs.load(std::memory_order_relaxed) / 1000.0 };
+}
+
+// --- HILO DEL DESTINO ---
+// Vacía la cola de un saque y rearma los mensajes de canal en un MidiOutBuffer: lo que
+// llegó junto con el mismo tiempo sale en un solo send, como salía del secuenciador.
+// Sin SCHED_FIFO ni afinidad a propósito: un puerto lento o trabado no le roba el core
+// al clock ni a los callbacks, que siguen con más prioridad.
+void OutputDestination::run() {
+    TimedSink timed(sink, maxSendNs);
+    MidiOutBuffer buf(&timed);
+    long long due = 0;
+    size_t pending = 0;
+    long long batchEntry = 0; // Marca de callback del lote en curso (una por lote)
+
+    auto delayNow = [&]() {
+        long long now = monoNowNs();
+        return (due > now) ? due - now : 0;
+    };
+    auto flush = [&]() {
+        if (pending == 0) return;
+        buf.flush(delayNow());
+        messages.fetch_add(pending, std::memory_order_relaxed);
+        pending = 0;
+        recordCallbackLatency(batchEntry);
+        batchEntry = 0;
+    };
+
+    for (;;) {
+        while (sem_wait(&wake) != 0 && errno == EINTR) {}
+        bool keepGoing = running.load(std::memory_order_acquire);
+
+        OutEvent ev;
+        while (queue.pop(ev)) {
+            if (ev.size == 0) {
+                flush();
+                sink->cancelScheduled();
+                continue;
+            }
+            // Antes de que MidiOutBuffer se vacíe solo (sin el delay)
+            if (ev.dueNs != due || pending >= MAX_BATCH || (ev.entryNs && batchEntry)) {
+                flush();
+                due = ev.dueNs;
+            }
+            unsigned char status = ev.data[0];
+            if (status < 0xF0 && ev.size == 2) {
+                buf.add(status, ev.data[1]);
+                pending++;
+                if (ev.entryNs) batchEntry = ev.entryNs;
+            } else if (status < 0xF0 && ev.size == 3) {
+                buf.add(status, ev.data[1], ev.data[2]);
+                pending++;
+                if (ev.entryNs) batchEntry = ev.entryNs;
+            } else { // Sistema: tal cual, después de lo anterior
+                flush();
+                timed.send(ev.data, ev.size, delayNow());
+                messages.fetch_add(1, std::memory_order_relaxed);
+                recordCallbackLatency(ev.entryNs);
+            }
+        }
+        flush();
+        sendOwed(buf);
+        if (!keepGoing) break;
+    }
+}
@@ -0,0 +1,146 @@
+#include "electone.h"
+
+#ifdef ELECTONE_WITH_FLUIDSYNTH
+#include <fluidsynth.h>
+#include <cstring>
+#include <time.h>
+
+struct FluidState {
+    FluidConfig cfg;
+    fluid_settings_t* settings = nullptr;
+    fluid_synth_t* synth = nullptr;
+    fluid_audio_driver_t* driver = nullptr;
+    fluid_file_renderer_t* renderer = nullptr;
+
+    double pendingFrames = 0; // Resto de advance() que no llegó a un bloque
+    std::thread renderThread;
+    std::atomic<bool> rendering{false};
+};
+
+// --- CALLBACK DE AUDIO ---
+// Lo llama el driver de FluidSynth cada periodSize frames; medimos cuánto tarda
+static int audioCallback(void* data, int len, int nfx, float* fx[], int nout, float* out[]) {
+    FluidState* st = (FluidState*)data;
+    long long t0 = monoNowNs();
+    for (int i = 0; i < nfx; i++) if (fx[i]) memset(fx[i], 0, len * sizeof(float));
+    for (int i = 0; i < nout; i++) if (out[i]) memset(out[i], 0, len * sizeof(float));
+    int res = fluid_synth_process(st->synth, len, nfx, fx, nout, out);
+    metrics.audioCallback.record(monoNowNs() - t0);
+    return res;
+}
+
+FluidSynthSink::FluidSynthSink(const FluidConfig& cfg) {
+    FluidState* st = new FluidState();
+    st->cfg = cfg;
+    st->settings = new_fluid_settings();
+    fluid_settings_setnum(st->settings, "synth.gain", cfg.gain);
+    fluid_settings_setnum(st->settings, "synth.sample-rate", cfg.sampleRate);
+    fluid_settings_setint(st->settings, "audio.period-size", cfg.periodSize);
+    fluid_settings_setint(st->settings, "audio.periods", cfg.periods);
+    if (cfg.renderFile.empty()) {
+        fluid_settings_setstr(st->settings, "audio.driver", "alsa");
+        fluid_settings_setstr(st->settings, "audio.alsa.device", cfg.audioDevice.c_str());
+    } else {
+        fluid_settings_setstr(st->settings, "audio.file.name", cfg.renderFile.c_str());
+        fluid_settings_setstr(st->settings, "audio.file.type", "wav");
+    }
+
+    st->synth = new_fluid_synth(st->settings);
+    if (!st->synth || fluid_synth_sfload(st->synth, cfg.soundfont.c_str(), 1) == FLUID_FAILED) {
+        std::cerr << "Error FluidSynth: no se pudo cargar " << cfg.soundfont << std::endl;
+        if (st->synth) delete_fluid_synth(st->synth);
+        delete_fluid_settings(st->settings);
+        delete st;
+        return;
+    }
+
+    if (cfg.renderFile.empty()) {
+        st->driver = new_fluid_audio_driver2(st->settings, audioCallback, st);
+        if (!st->driver) std::cerr << "Error FluidSynth: no se pudo abrir " << cfg.audioDevice << std::endl;
+        else std::cout << "Output: FluidSynth interno (" << cfg.audioDevice << ", " << cfg.periodSize << " frames)" << std::endl;
+    } else {
+        st->renderer = new_fluid_file_renderer(st->synth);
+        if (!st->renderer) std::cerr << "Error FluidSynth: no se pudo crear " << cfg.renderFile << std::endl;
+        else std::cout << "Output: FluidSynth interno -> " << cfg.renderFile << std::endl;
+    }
+    state = st;
+}
+
+FluidSynthSink::~FluidSynthSink() {
+    if (!state) return;
+    if (state->rendering.exchange(false) && state->renderThread.joinable()) state->renderThread.join();
+    if (state->driver) delete_fluid_audio_driver(state->driver);
+    if (state->renderer) delete_fluid_file_renderer(state->renderer);
+    delete_fluid_synth(state->synth);
+    delete_fluid_settings(state->settings);
+    delete state;
+}
+
+// --- MIDI -> LLAMADAS DIRECTAS ---
+// El stream puede traer varios mensajes y running status; clock y demás realtime se ignoran.
+void FluidSynthSink::send(const unsigned char* data, size_t size, long long delayNs) {
+    if (!state) return;
+    fluid_synth_t* synth = state->synth;
+    unsigned char status = 0;
+    size_t i = 0;
+    while (i < size) {
+        unsigned char b = data[i];
+        if (b >= 0xF8) { i++; continue; } // Realtime
+        if (b == 0xF0) {
+            size_t end = i + 1;
+            while (end < size && data[end] != 0xF7) end++;
+            if (end < size) fluid_synth_sysex(synth, (const char*)data + i + 1, (int)(end - i - 1), nullptr, nullptr, nullptr, 0);
+            i = end + 1;
+            status = 0;
+            continue;
+        }
+        if (b & 0x80) { status = b; i++; }
+        if (status == 0) { i++; continue; } // Dato suelto sin status
+
+        int type = status & 0xF0;
+        int ch = status & 0x0F;
+        int len = (type == 0xC0 || type == 0xD0) ? 1 : 2;
+        if (i + len > size) break;
+        int d1 = data[i];
+        int d2 = (len == 2) ? data[i + 1] : 0;
+        i += len;
+
+        switch (type) {
+        case 0x80: fluid_synth_noteoff(synth, ch, d1); break;
+        case 0x90: if (d2 > 0) fluid_synth_noteon(synth, ch, d1, d2); else fluid_synth_noteoff(synth, ch, d1); break;
+        case 0xA0: fluid_synth_key_pressure(synth, ch, d1, d2); break;
+        case 0xB0: fluid_synth_cc(synth, ch, d1, d2); break; // CC 0/32 = bank select
+        case 0xC0: fluid_synth_program_change(synth, ch, d1); break;
+        case 0xD0: fluid_synth_channel_pressure(synth, ch, d1); break;
+        case 0xE0: fluid_synth_pitch_bend(synth, ch, d1 | (d2 << 7)); break;
+        }
+    }
+}
+
+// --- RENDER A ARCHIVO ---
+void FluidSynthSink::advance(long long ns) {
+    if (!state || !state->renderer) return;
+    state->pendingFrames += ns * state->cfg.sampleRate / 1e9;
+    while (state->pendingFrames >= state->cfg.periodSize) {
+        fluid_file_renderer_process_block(state->renderer);
+        state->pendingFrames -= state->cfg.periodSize;
+    }
+}
+
+void FluidSynthSink::startRealtimeRender() {
+    if (!state || !state->renderer || state->rendering.exchange(true)) return;
+    state->renderThread = std::thread([this]() {
+        FluidState* st = state;
+        long long period = (long long)(st->cfg.periodSize * 1e9 / st->cfg.sampleRate);
+        long long deadline = monoNowNs();
+        while (st->rendering.load(std::memory_order_relaxed)) {
+            deadline += period;
+            timespec ts = { (time_t)(deadline / 1000000000LL), (long)(deadline % 1000000000LL) };
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+            long long t0 = monoNowNs();
+            fluid_file_renderer_process_block(st->renderer);
+            metrics.audioCallback.record(monoNowNs() - t0);
+        }
+    });
+}
+#endif
@@ -1,11 +1,50 @@
 #include "electone.h"
 #include <yaml-cpp/yaml.h>
+#include <stdexcept>
+#include <numeric>
 
 // Definimos las variables globales de DB aquí
 std::map<int, SoundPatch> generalSoundsDB;
 std::map<int, SoundPatch> leadSoundsDB;
 
-void loadInstrumentDB(const std::string& filename) {
+// Puntero crudo como el pendingBank del secuenciador: el reemplazado va a retiredSounds y
+// lo libera el loop principal cuando no queda ningún lector adentro
+static std::atomic<const SoundBank*> soundBank{new SoundBank()};
+static std::atomic<int> soundReaders{0};
+static MpscQueue<const SoundBank*, 8> retiredSounds;
+
+// Primero se anota como lector y después lee el puntero: el que libera ve al lector
+SoundsRef::SoundsRef() {
+    soundReaders.fetch_add(1);
+    bank = soundBank.load();
+}
+
+SoundsRef::~SoundsRef() { soundReaders.fetch_sub(1); }
+
+void publishSounds(std::map<int, SoundPatch> general, std::map<int, SoundPatch> lead) {
+    SoundBank* sb = new SoundBank();
+    sb->general = std::move(general);
+    sb->lead = std::move(lead);
+    const SoundBank* old = soundBank.exchange(sb);
+    if (!retiredSounds.push(old)) {
+        // El loop principal no liberó en 8 recargas: mejor perder memoria que liberar en uso
+        std::cerr << "Aviso: banco de sonidos retirado sin liberar" << std::endl;
+    }
+}
+
+void freeRetiredSounds() {
+    static std::vector<const SoundBank*> waiting; // Solo lo toca el loop principal
+    const SoundBank* old;
+    while (retiredSounds.pop(old)) waiting.push_back(old);
+    // Ya sacados de la cola: un lector que todavía los tenga ya estaba anotado
+    if (waiting.empty() || soundReaders.load() != 0) return;
+    for (const SoundBank* sb : waiting) delete sb;
+    waiting.clear();
+}
+
+bool loadInstrumentDB(const std::string& filename) {
+    // Se arma aparte: con un error a mitad de archivo las tablas quedan como estaban
+    std::map<int, SoundPatch> general, lead;
     try {
         std::cout << "Cargando Sonidos: " << filename << std::endl;
         YAML::Node config = YAML::LoadFile(filename);
@@ -21,7 +60,7 @@ void loadInstrumentDB(const std::string& filename) {
                     p.bank = values[0];
                     p.program = values[1];
                 }
-                generalSoundsDB[id] = p;
+                general[id] = p;
             }
         }
 
@@ -40,19 +79,24 @@ void loadInstrumentDB(const std::string& filename) {
                     p.portamento = (values[2] == 1);
                     p.portamentoTime = values[3];
                 }
-                leadSoundsDB[id] = p;
+                lead[id] = p;
             }
         }
         std::cout << "  -> Sonidos cargados OK." << std::endl;
 
     } catch (const YAML::Exception& e) {
         std::cerr << "Error YAML Sounds: " << e.what() << std::endl;
+        return false;
     }
+    generalSoundsDB = std::move(general);
+    leadSoundsDB = std::move(lead);
+    return true;
 }
 
 // ... (Acá siguen las funciones loadDrumStyles y loadAcompStyles igual que antes) ...
-std::map<int, DrumStyle> loadDrumStyles(const std::string& filename) {
+std::map<int, DrumStyle> loadDrumStyles(const std::string& filename, bool* ok) {
     std::map<int, DrumStyle> db;
+    if (ok) *ok = true;
     try {
         std::cout << "Cargando Ritmos: " << filename << std::endl;
         YAML::Node config = YAML::LoadFile(filename);
@@ -61,10 +105,13 @@ std::map<int, DrumStyle> loadDrumStyles(const std::string& filename) {
             int styleId = styleNode.first.as<int>();
             DrumStyle ds;
             if (styleNode.second["steps"]) ds.steps = styleNode.second["steps"].as<int>();
+            if (styleNode.second["gate"]) ds.gate = styleNode.second["gate"].as<int>();
+            if (styleNode.second["swing"]) ds.swing = styleNode.second["swing"].as<int>();
+            if (styleNode.second["humanize"]) ds.humanize = styleNode.second["humanize"].as<int>();
 
             for (const auto& content : styleNode.second) {
                 std::string key = content.first.as<std::string>();
-                if (key == "steps") continue;
+                if (key == "steps" || key == "gate" || key == "swing" || key == "humanize") continue;
 
                 if (key == "fills") {
                     for (const auto& fillNode : content.second) {
@@ -74,7 +121,10 @@ std::map<int, DrumStyle> loadDrumStyles(const std::string& filename) {
                         } else {
                             int fId = fillNode.first.as<int>();
                             for (const auto& tr : fillNode.second) {
-                                if (tr.first.as<std::string>() == "resolution") continue;
+                                if (tr.first.as<std::string>() == "resolution") {
+                                    for (const auto& r : tr.second) ds.fills[fId].resolution[r.first.as<int>()] = r.second.as<int>();
+                                    continue;
+                                }
                                 ds.fills[fId].tracks[tr.first.as<int>()] = tr.second.as<std::vector<int>>();
                             }
                         }
@@ -92,12 +142,28 @@ std::map<int, DrumStyle> loadDrumStyles(const std::string& filename) {
         }
     } catch (const YAML::Exception& e) {
         std::cerr << "Error YAML Ritmos: " << e.what() << std::endl;
+        if (ok) *ok = false;
     }
     return db;
 }
 
-std::map<int, AcompStyle> loadAcompStyles(const std::string& filename) {
+static AcompPart loadAcompPart(const YAML::Node& data) {
+    AcompPart ap;
+    if (data["channel"]) ap.channel = data["channel"].as<int>();
+    if (data["program"]) ap.program = data["program"].as<int>();
+    if (data["mode"]) ap.mode = data["mode"].as<std::string>();
+    if (data["velocity"]) ap.velocity = data["velocity"].as<int>();
+    if (data["steps"]) ap.steps = data["steps"].as<int>();
+    if (data["octave"]) ap.octave = data["octave"].as<int>();
+    if (data["voice-leading"]) ap.voiceLead = data["voice-leading"].as<bool>();
+    if (data["gate"]) ap.gate = data["gate"].as<int>();
+    if (data["pattern"]) ap.pattern = data["pattern"].as<std::vector<int>>();
+    return ap;
+}
+
+std::map<int, AcompStyle> loadAcompStyles(const std::string& filename, bool* ok) {
     std::map<int, AcompStyle> db;
+    if (ok) *ok = true;
     try {
         std::cout << "Cargando Acomp: " << filename << std::endl;
         YAML::Node config = YAML::LoadFile(filename);
@@ -111,11 +177,12 @@ std::map<int, AcompStyle> loadAcompStyles(const std::string& filename) {
                 AcompPattern ap;
                 YAML::Node data = patNode.second;
 
-                if (data["program"]) ap.program = data["program"].as<int>();
-                if (data["mode"]) ap.mode = data["mode"].as<std::string>();
-                if (data["velocity"]) ap.velocity = data["velocity"].as<int>();
-                if (data["steps"]) ap.steps = data["steps"].as<int>();
-                if (data["pattern"]) ap.pattern = data["pattern"].as<std::vector<int>>();
+                // parts: varias a la vez; si no, el patrón mismo es la única parte
+                if (data["parts"]) {
+                    for (const auto& partNode : data["parts"]) ap.parts.push_back(loadAcompPart(partNode));
+                } else {
+                    ap.parts.push_back(loadAcompPart(data));
+                }
 
                 as.patterns[patId] = ap;
             }
@@ -123,6 +190,212 @@ std::map<int, AcompStyle> loadAcompStyles(const std::string& filename) {
         }
     } catch (const YAML::Exception& e) {
         std::cerr << "Error YAML Acomp: " << e.what() << std::endl;
+        if (ok) *ok = false;
     }
     return db;
 }
+
+// --- COMPILACIÓN A TABLAS PLANAS ---
+// Se hace una sola vez al cargar: el clock después lee un paso con un solo índice,
+// sin maps ni recorrer pistas en silencio.
+
+static void checkNote(int note, const std::string& where) {
+    if (note < 0 || note > 127) throw std::runtime_error(where + ": nota fuera de rango (" + std::to_string(note) + ")");
+}
+
+static void checkVelocity(int vel, const std::string& where) {
+    if (vel < 0 || vel > 127) throw std::runtime_error(where + ": velocidad fuera de rango (" + std::to_string(vel) + ")");
+}
+
+static void checkGate(int gate, const std::string& where) {
+    if (gate < 1 || gate > MAX_GATE_TICKS) throw std::runtime_error(where + ": gate fuera de rango (" + std::to_string(gate) + ")");
+}
+
+// Gate del golpe en el paso s: el propio más 6 ticks por cada -1 (ligadura) que le sigue
+static unsigned short tiedGate(const std::vector<int>& track, int steps, int s, int gate) {
+    for (int t = s + 1; t < steps && track[t] == -1; t++) gate += 6;
+    return (unsigned short)std::min(gate, MAX_GATE_TICKS);
+}
+
+// Un -1 tiene que seguir a un golpe o a otra ligadura
+static void checkTies(const std::vector<int>& track, int steps, const std::string& where) {
+    for (int s = 0; s < steps; s++) {
+        if (track[s] == -1 && (s == 0 || track[s - 1] == 0))
+            throw std::runtime_error(where + ": ligadura sin nota previa en el paso " + std::to_string(s));
+    }
+}
+
+static CompiledPattern compilePattern(const DrumPattern& p, int steps, int gate, const std::string& where) {
+    CompiledPattern cp;
+    cp.steps = steps;
+    for (auto const& [note, track] : p.tracks) {
+        checkNote(note, where);
+        if ((int)track.size() < steps) {
+            throw std::runtime_error(where + ", pista " + std::to_string(note) + ": tiene " +
+                                     std::to_string(track.size()) + " pasos y el estilo pide " + std::to_string(steps));
+        }
+        checkTies(track, steps, where + ", pista " + std::to_string(note));
+    }
+    cp.offsets.reserve(steps + 1);
+    for (int s = 0; s < steps; s++) {
+        cp.offsets.push_back((unsigned short)cp.events.size());
+        for (auto const& [note, track] : p.tracks) {
+            int v = track[s];
+            if (v < -1) throw std::runtime_error(where + ", pista " + std::to_string(note) + ": valor de paso inválido (" + std::to_string(v) + ")");
+            if (v <= 0) continue;
+            checkVelocity(v, where);
+            int vel = (v == 1) ? 100 : v;
+            cp.events.push_back({(unsigned char)note, (unsigned char)vel, tiedGate(track, steps, s, gate)});
+        }
+    }
+    cp.offsets.push_back((unsigned short)cp.events.size());
+    return cp;
+}
+
+static CompiledPattern compileResolution(const std::map<int, int>& res, int gate, const std::string& where) {
+    CompiledPattern cp;
+    if (res.empty()) return cp;
+    cp.steps = 1;
+    cp.offsets.push_back(0);
+    for (auto const& [note, vel] : res) {
+        checkNote(note, where);
+        checkVelocity(vel, where);
+        cp.events.push_back({(unsigned char)note, (unsigned char)vel, (unsigned short)gate});
+    }
+    cp.offsets.push_back((unsigned short)cp.events.size());
+    return cp;
+}
+
+std::vector<CompiledDrumStyle> compileDrumStyles(const std::map<int, DrumStyle>& db, bool* ok) {
+    std::vector<CompiledDrumStyle> out;
+    if (ok) *ok = true;
+    for (auto const& [styleId, ds] : db) {
+        std::string where = "Ritmo " + std::to_string(styleId);
+        try {
+            if (styleId < 0 || styleId > 127) throw std::runtime_error(where + ": id fuera de rango");
+            if (ds.steps <= 0 || ds.steps > 256) throw std::runtime_error(where + ": steps inválido (" + std::to_string(ds.steps) + ")");
+            checkGate(ds.gate, where);
+            // Más de 5 ticks y la semi impar se pisaría con la siguiente
+            if (ds.swing < 0 || ds.swing > 5) throw std::runtime_error(where + ": swing fuera de rango (0..5)");
+            if (ds.humanize < 0 || ds.humanize > 64) throw std::runtime_error(where + ": humanize fuera de rango (0..64)");
+
+            CompiledDrumStyle cs;
+            cs.steps = ds.steps;
+            cs.swing = (unsigned char)ds.swing;
+            cs.humanize = (unsigned char)ds.humanize;
+            for (auto const& [varId, p] : ds.variations) {
+                if (varId < 0 || varId > 127) throw std::runtime_error(where + ": variación fuera de rango");
+                if ((int)cs.variations.size() <= varId) cs.variations.resize(varId + 1);
+                cs.variations[varId] = compilePattern(p, ds.steps, ds.gate, where + ", variación " + std::to_string(varId));
+            }
+            for (auto const& [fillId, p] : ds.fills) {
+                if (fillId < 0 || fillId > 127) throw std::runtime_error(where + ": fill fuera de rango");
+                std::string fWhere = where + ", fill " + std::to_string(fillId);
+                if ((int)cs.fills.size() <= fillId) {
+                    cs.fills.resize(fillId + 1);
+                    cs.resolutions.resize(fillId + 1);
+                }
+                cs.fills[fillId] = compilePattern(p, ds.steps, ds.gate, fWhere);
+                // El remate propio del fill tiene prioridad sobre el general
+                cs.resolutions[fillId] = compileResolution(p.resolution.empty() ? ds.resolution : p.resolution, ds.gate, fWhere);
+            }
+            cs.valid = true;
+
+            if ((int)out.size() <= styleId) out.resize(styleId + 1);
+            out[styleId] = std::move(cs);
+        } catch (const std::exception& e) {
+            std::cerr << "Error compilando " << e.what() << " -> estilo descartado" << std::endl;
+            if (ok) *ok = false;
+        }
+    }
+    return out;
+}
+
+static CompiledAcompPart compileAcompPart(const AcompPart& ap, const std::string& where) {
+    if (ap.steps <= 0 || ap.steps > 256) throw std::runtime_error(where + ": steps inválido");
+    if ((int)ap.pattern.size() < ap.steps) {
+        throw std::runtime_error(where + ": el patrón tiene " + std::to_string(ap.pattern.size()) +
+                                 " pasos y pide " + std::to_string(ap.steps));
+    }
+    if (ap.channel < 0 || ap.channel > 15) throw std::runtime_error(where + ": channel fuera de rango (0..15)");
+    if (ap.program < 0 || ap.program > 127) throw std::runtime_error(where + ": program fuera de rango");
+    checkVelocity(ap.velocity, where);
+    checkGate(ap.gate, where);
+    checkTies(ap.pattern, ap.steps, where);
+
+    CompiledAcompPart cp;
+    if (ap.mode == "chord") cp.mode = AcompMode::Chord;
+    else if (ap.mode == "arp-once") cp.mode = AcompMode::ArpOnce;
+    else if (ap.mode == "arp-loop") cp.mode = AcompMode::ArpLoop;
+    else if (ap.mode == "degree") cp.mode = AcompMode::Degree;
+    else throw std::runtime_error(where + ": modo desconocido '" + ap.mode + "'");
+
+    cp.channel = (unsigned char)ap.channel;
+    cp.program = (unsigned char)ap.program;
+    cp.velocity = (unsigned char)ap.velocity;
+    if (ap.octave < -1 || ap.octave > 8) throw std::runtime_error(where + ": octave fuera de rango");
+    cp.baseNote = 12 * (ap.octave + 1);
+    cp.voiceLead = ap.voiceLead;
+    int maxValue = cp.mode == AcompMode::Degree ? 9 : 127;
+    for (int s = 0; s < ap.steps; s++) {
+        int v = ap.pattern[s];
+        if (v < -1 || v > maxValue) throw std::runtime_error(where + ": valor de paso inválido (" + std::to_string(v) + ")");
+    }
+    return cp;
+}
+
+std::vector<CompiledAcompStyle> compileAcompStyles(const std::map<int, AcompStyle>& db, bool* ok) {
+    std::vector<CompiledAcompStyle> out;
+    if (ok) *ok = true;
+    for (auto const& [styleId, as] : db) {
+        std::string where = "Acomp " + std::to_string(styleId);
+        try {
+            if (styleId < 0 || styleId > 127) throw std::runtime_error(where + ": id fuera de rango");
+
+            CompiledAcompStyle cs;
+            for (auto const& [patId, ap] : as.patterns) {
+                std::string pWhere = where + ", patrón " + std::to_string(patId);
+                if (patId < 0 || patId > 127) throw std::runtime_error(pWhere + ": id fuera de rango");
+                if (ap.parts.empty() || (int)ap.parts.size() > MAX_ACOMP_PARTS)
+                    throw std::runtime_error(pWhere + ": entre 1 y " + std::to_string(MAX_ACOMP_PARTS) + " partes");
+
+                CompiledAcompPattern cp;
+                cp.steps = 1;
+                for (size_t i = 0; i < ap.parts.size(); i++) {
+                    const AcompPart& part = ap.parts[i];
+                    std::string partWhere = ap.parts.size() > 1 ? pWhere + ", parte " + std::to_string(i) : pWhere;
+                    cp.parts.push_back(compileAcompPart(part, partWhere));
+                    cp.steps = std::lcm(cp.steps, part.steps);
+                    if (cp.steps > MAX_ACOMP_STEPS) throw std::runtime_error(pWhere + ": las partes no cierran antes de " +
+                                                                             std::to_string(MAX_ACOMP_STEPS) + " pasos");
+                }
+
+                // Mezcla: un solo flujo ordenado por paso, y dentro del paso por parte
+                cp.offsets.reserve(cp.steps + 1);
+                for (int s = 0; s < cp.steps; s++) {
+                    cp.offsets.push_back((unsigned short)cp.events.size());
+                    for (size_t i = 0; i < ap.parts.size(); i++) {
+                        const AcompPart& part = ap.parts[i];
+                        int ps = s % part.steps;
+                        int v = part.pattern[ps];
+                        if (v <= 0) continue; // La ligadura no ataca: alarga el gate del golpe anterior
+                        cp.events.push_back({(unsigned char)i, (unsigned char)v, tiedGate(part.pattern, part.steps, ps, part.gate)});
+                    }
+                }
+                cp.offsets.push_back((unsigned short)cp.events.size());
+                cp.valid = true;
+
+                if ((int)cs.patterns.size() <= patId) cs.patterns.resize(patId + 1);
+                cs.patterns[patId] = std::move(cp);
+            }
+            cs.valid = true;
+
+            if ((int)out.size() <= styleId) out.resize(styleId + 1);
+            out[styleId] = std::move(cs);
+        } catch (const std::exception& e) {
+            std::cerr << "Error compilando " << e.what() << " -> estilo descartado" << std::endl;
+            if (ok) *ok = false;
+        }
+    }
+    return out;
+}
@@ -0,0 +1,121 @@
+#ifndef LOCKFREE_H
+#define LOCKFREE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// --- COLA ACOTADA MULTI-PRODUCTOR / UN CONSUMIDOR ---
+// Anillo con número de secuencia por celda (esquema de Vyukov).
+// Los productores (callbacks de RtMidi) nunca bloquean: si está llena, push() devuelve false.
+// Solo un hilo puede llamar a pop().
+template <typename T, size_t N>
+class MpscQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "N tiene que ser potencia de 2");
+
+public:
+    MpscQueue() {
+        for (size_t i = 0; i < N; i++) cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    bool push(const T& value) {
+        Cell* cell;
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells[pos & (N - 1)];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+            if (dif == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (dif < 0) {
+                return false; // Llena
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = value;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& value) {
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        Cell& cell = cells[pos & (N - 1)];
+        size_t seq = cell.seq.load(std::memory_order_acquire);
+        if ((intptr_t)seq - (intptr_t)(pos + 1) < 0) return false; // Vacía
+        value = cell.data;
+        cell.seq.store(pos + N, std::memory_order_release);
+        dequeuePos.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Aproximado (puede cambiar mientras se lee)
+    size_t size() const {
+        size_t in = enqueuePos.load(std::memory_order_acquire);
+        size_t out = dequeuePos.load(std::memory_order_acquire);
+        return in >= out ? in - out : 0;
+    }
+
+    static constexpr size_t capacity() { return N; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+    Cell cells[N];
+    alignas(64) std::atomic<size_t> enqueuePos{0};
+    alignas(64) std::atomic<size_t> dequeuePos{0};
+};
+
+// --- SEQLOCK (un escritor, muchos lectores) ---
+// El escritor nunca espera: incrementa la secuencia (impar = escribiendo), copia y vuelve
+// a incrementar. El lector reintenta si la secuencia cambió o era impar. Los datos van
+// en palabras atómicas relajadas para que la lectura concurrente no sea una carrera.
+template <typename T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock solo copia tipos triviales");
+    static const size_t WORDS = (sizeof(T) + 3) / 4;
+
+public:
+    void store(const T& value) {
+        uint32_t w[WORDS] = {};
+        memcpy(w, &value, sizeof(T));
+        unsigned s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORDS; i++) words[i].store(w[i], std::memory_order_relaxed);
+        seq.store(s + 2, std::memory_order_release);
+    }
+
+    T load() const {
+        uint32_t w[WORDS];
+        unsigned s0, s1;
+        do {
+            s0 = seq.load(std::memory_order_acquire);
+            for (size_t i = 0; i < WORDS; i++) w[i] = words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            s1 = seq.load(std::memory_order_relaxed);
+        } while (s0 != s1 || (s0 & 1));
+        T value;
+        memcpy(&value, w, sizeof(T));
+        return value;
+    }
+
+    // Cambia con cada store: el lector puede saltear lo que ya vio
+    unsigned version() const { return seq.load(std::memory_order_acquire); }
+
+private:
+    std::atomic<unsigned> seq{0};
+    std::atomic<uint32_t> words[WORDS] = {};
+};
+
+// Guarda el máximo visto sin locks
+inline void atomicMax(std::atomic<unsigned>& target, unsigned value) {
+    unsigned prev = target.load(std::memory_order_relaxed);
+    while (value > prev && !target.compare_exchange_weak(prev, value, std::memory_order_relaxed)) {}
+}
+
+#endif
@@ -1,54 +1,280 @@
 #include "electone.h"
 #include <thread>
 #include <chrono>
+#include <cstring>
+#include <csignal>
+#include <cctype>
 
 // Globales
 Sequencer* seq = nullptr;
 RtMidiOut* midiOut = nullptr;
+RtMidiSink* rtSink = nullptr;
+MidiSink* outSink = nullptr; // Destino de patches, volúmenes y SysEx (RtMidi o FluidSynth interno)
+MidiSink* clockSink = nullptr; // Reenvío de 0xF8 / start / stop
+std::vector<OutputDestination*> outputs; // Un hilo y una cola por destino (el sintetizador y los --out)
+std::vector<RtMidiOut*> extraPorts;
+std::vector<RtMidiSink*> extraSinks;
+OutputFanout* seqFanout = nullptr;
+OutputFanout* outFanout = nullptr;
+#ifdef ELECTONE_WITH_FLUIDSYNTH
+FluidSynthSink* fluidSink = nullptr; // Solo con --fluidsynth
+#endif
+#ifdef ELECTONE_WITH_ALSA_SEQ
+AlsaSeqSink* alsaSink = nullptr; // Solo con --lookahead
+#endif
+InternalClock* internalClock = nullptr; // Solo con --internal-clock
+BankWatcher* watcher = nullptr;
+DisplaySink* displaySink = nullptr;  // Solo con --display
+PanelDisplay* display = nullptr;
+Recorder* recorder = nullptr;
+RecordingSink* seqRecSink = nullptr; // Envuelven los destinos para que el grabador vea lo que sale
+RecordingSink* outRecSink = nullptr;
+RoutingTable routing; // Se carga una vez, antes de abrir los puertos de entrada
+RegistrationMemory registrations("registrations.yaml");
 
-// Envía mensajes cortos (3 bytes)
+// SysEx sin ruta: el callback solo los copia acá; el loop principal los imprime
+struct UnknownSysex {
+    unsigned char size;
+    unsigned char data[31]; // Alcanza para ver el header y el botón
+};
+MpscQueue<UnknownSysex, 16> unknownSysex;
+std::atomic<unsigned long> unknownSysexDropped{0};
+
+void printUnknownSysex() {
+    UnknownSysex u;
+    while (unknownSysex.pop(u)) {
+        char hex[3 * sizeof(u.data) + 1] = "";
+        size_t n = 0;
+        for (size_t i = 0; i < u.size; i++) n += snprintf(hex + n, sizeof(hex) - n, "%02X ", u.data[i]);
+        std::cout << "SysEx sin ruta: " << hex << std::endl;
+    }
+    unsigned long lost = unknownSysexDropped.exchange(0);
+    if (lost > 0) std::cout << "SysEx sin ruta: " << lost << " más sin imprimir" << std::endl;
+}
+
+// Pedido de volcado de métricas (SIGUSR1 o botón del Korg); lo atiende el loop principal
+std::atomic<bool> dumpRequested{false};
+void onSigUsr1(int) { dumpRequested = true; }
+
+void dumpAllStats() {
+    dumpMetrics(std::cout);
+    dumpRealtimeStats(std::cout);
+    ControlStats cs = seq->controlStats();
+    OutputStats os = seq->outputStats();
+    std::cout << "Cola de control: máx " << cs.highWater << "/" << CONTROL_QUEUE_SIZE << ", descartados " << cs.dropped << std::endl;
+    std::cout << "Salida: " << os.messages << " mensajes en " << os.sends << " envíos" << std::endl;
+    for (OutputDestination* d : outputs) {
+        OutputDestStats ds = d->stats();
+        std::cout << "Destino " << d->getName() << ": " << ds.messages << " mensajes, cola máx " << ds.highWater << ", "
+                  << ds.dropped << " perdidos (cola llena), " << ds.skipped << " SysEx largos, peor envío "
+                  << ds.maxSendUs << " us" << std::endl;
+    }
+    ClockPllStats ps = seq->clockStats();
+    std::cout << "PLL del clock: " << ps.locks << " enganches, " << ps.stops << " paradas, " << ps.jumps
+              << " saltos de tempo, error de fase máx " << ps.maxPhaseErrorUs << " us" << std::endl;
+    if (internalClock) {
+        ClockStats st = internalClock->stats();
+        std::cout << "Clock interno: jitter medio " << st.meanJitterUs << " us, máx " << st.maxJitterUs << " us" << std::endl;
+    }
+    RegistrationStats gs = registrations.stats();
+    std::cout << "Registraciones: " << gs.recalls << " recuperadas, " << gs.stores << " guardadas, " << gs.sent
+              << " mensajes mandados, " << gs.skipped << " evitados (ya estaban)" << std::endl;
+    RecorderStats rs = recorder->stats();
+    std::cout << "Grabador: " << (rs.recording ? "grabando, " : "") << rs.events << " mensajes, " << rs.takes << " tomas, "
+              << rs.overruns << " perdidos (anillo lleno), " << rs.skipped << " SysEx largos" << std::endl;
+    if (display) {
+        DisplayStats ds = display->stats();
+        std::cout << "Pantalla: " << ds.frames << " cuadros, " << ds.rects << " rectángulos, " << ds.pixels << " píxeles" << std::endl;
+    }
+}
+
+// "<puerto>[:<canales>[:<semitonos>]]", canales como "1-4,10"
+bool parseOutputSpec(const std::string& spec, std::string& port, OutputFilter& filter) {
+    size_t c1 = spec.find(':');
+    port = spec.substr(0, c1);
+    if (port.empty()) return false;
+    if (c1 == std::string::npos) return true;
+    size_t c2 = spec.find(':', c1 + 1);
+    std::string chans = spec.substr(c1 + 1, c2 == std::string::npos ? std::string::npos : c2 - c1 - 1);
+    if (!chans.empty()) {
+        filter.channels = 0;
+        size_t pos = 0;
+        while (pos < chans.size()) {
+            size_t comma = chans.find(',', pos);
+            std::string item = chans.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+            int lo = 0, hi = 0;
+            size_t dash = item.find('-');
+            lo = atoi(item.c_str());
+            hi = (dash == std::string::npos) ? lo : atoi(item.c_str() + dash + 1);
+            if (lo < 1 || hi > 16 || lo > hi) return false;
+            for (int ch = lo; ch <= hi; ch++) filter.channels |= (unsigned short)(1 << (ch - 1));
+            if (comma == std::string::npos) break;
+            pos = comma + 1;
+        }
+    }
+    if (c2 != std::string::npos) filter.transpose = atoi(spec.c_str() + c2 + 1);
+    return filter.transpose >= -48 && filter.transpose <= 48;
+}
+
+// Envía mensajes cortos (3 bytes), desde la pila: sin alocar
 void sendMidi(int status, int d1, int d2) {
-    std::vector<unsigned char> msg = {(unsigned char)status, (unsigned char)d1, (unsigned char)d2};
-    midiOut->sendMessage(&msg);
+    unsigned char msg[3] = {(unsigned char)status, (unsigned char)d1, (unsigned char)d2};
+    outSink->send(msg, sizeof(msg));
+    markOutputSent();
 }
 
-// Función auxiliar para aplicar un Patch completo
+// Función auxiliar para aplicar un Patch completo (un solo envío)
 void applyPatch(int channel, const SoundPatch& patch) {
+    MidiOutBuffer buf(outSink);
+
     // 1. Bank Select (CC 0)
-    sendMidi(0xB0 + channel, 0, patch.bank);
+    buf.add(0xB0 + channel, 0, patch.bank);
 
     // 2. Program Change
-    std::vector<unsigned char> pcMsg = {(unsigned char)(0xC0 + channel), (unsigned char)patch.program};
-    midiOut->sendMessage(&pcMsg);
+    buf.add(0xC0 + channel, patch.program);
 
     // 3. Portamento (Solo si es lead o se especifica)
     // CC 65 (Portamento Switch)
-    sendMidi(0xB0 + channel, 65, patch.portamento ? 127 : 0);
+    buf.add(0xB0 + channel, 65, patch.portamento ? 127 : 0);
 
     // CC 5 (Portamento Time)
     if (patch.portamento) {
-        sendMidi(0xB0 + channel, 5, patch.portamentoTime);
+        buf.add(0xB0 + channel, 5, patch.portamentoTime);
     }
+    buf.flush();
+    noteChannelSent(channel, patchTarget(patch)); // Para que un recall sepa qué ya suena
 }
 
 // Función para enviar SysEx
-void sendSysEx(const std::vector<unsigned char>& data) {
-    midiOut->sendMessage(&data);
+void sendSysEx(const unsigned char* data, size_t size) {
+    outSink->send(data, size);
+    markOutputSent();
+}
+
+// --- RUTEO DE CONTROLES ---
+void runRoute(const Route& r, const unsigned char* msg, size_t size, int val) {
+    if (r.value >= 0) { // Botón con valor fijo: solo al apretar
+        if (val == 0) return;
+        val = r.value;
+    }
+
+    switch (r.action) {
+    case RouteAction::None: break;
+    case RouteAction::Forward:
+        outSink->send(msg, size);
+        markOutputSent();
+        break;
+    case RouteAction::ControlOut:
+        sendMidi(0xB0 + r.channel, r.number, val);
+        noteControlSent(r.channel, r.number, val);
+        break;
+    case RouteAction::PatchGeneral:
+    case RouteAction::PatchLead: {
+        SoundsRef sounds = currentSounds();
+        const std::map<int, SoundPatch>& db = (r.action == RouteAction::PatchLead) ? sounds->lead : sounds->general;
+        auto it = db.find(val);
+        if (it != db.end()) {
+            applyPatch(r.channel, it->second);
+            noteSelectedSound(r.channel, val);
+        }
+        break;
+    }
+
+    // Secuenciador
+    case RouteAction::Style: seq->setStyle(val); break;
+    case RouteAction::Var: seq->setVar(val); break;
+    case RouteAction::Fill: if (val > 0) seq->setFill(val); break;
+    case RouteAction::AcompPattern: seq->setAcompPattern(val); break;
+    case RouteAction::ChordMode: seq->setChordMode(val >= 64 ? 1 : 0); break; // Fingered / Single finger
+    case RouteAction::OctaveUp: if (val == 127) seq->changeOctave(1); break;
+    case RouteAction::OctaveDown: if (val == 127) seq->changeOctave(-1); break;
+
+    case RouteAction::MasterVolume: {
+        unsigned char sysex[] = {0xF0, 0x7F, 0x7F, 0x04, 0x01, 0x00, (unsigned char)val, 0xF7};
+        sendSysEx(sysex, sizeof(sysex));
+        break;
+    }
+    case RouteAction::DumpMetrics: if (val == 127) dumpRequested = true; break;
+    case RouteAction::Record: if (val == 127) recorder->toggleTake(); break;
+
+    // Registraciones: memoria y banco con 'value' fijo por botón
+    case RouteAction::Registration: if (val > 0) registrations.press(val, seq); break;
+    case RouteAction::RegistrationBank: if (val > 0) registrations.selectBank(val); break;
+    case RouteAction::RegistrationStore: if (val == 127) registrations.armStore(); break;
+    case RouteAction::Shutdown:
+        if (val == 127) {
+            std::cout << "SHUTDOWN..." << std::endl;
+            system("sudo shutdown -h now");
+        }
+        break;
+
+    // Clock interno: tempo 40..294 BPM, Play / Stop del transporte
+    case RouteAction::Tempo: if (internalClock) internalClock->setBpm(40 + val * 2); break;
+    case RouteAction::ClockStart: if (internalClock && val == 127) internalClock->start(); break;
+    case RouteAction::ClockStop: if (internalClock && val == 127) internalClock->requestStop(); break; // El informe sale del loop principal
+    }
+}
+
+// Un mensaje = un acceso indexado a la tabla compilada de routing.yaml y un switch
+void routeMessage(RoutePort port, const std::vector<unsigned char>& msg) {
+    if (msg.size() < 2 || msg[0] < 0x80 || msg[0] >= 0xF0) return;
+    int type = (msg[0] >> 4) & 7;
+    int val = msg.size() >= 3 ? msg[2] : msg[1];
+    if (type == 1 && val == 0) type = 0; // Note on con velocidad 0 = note off
+    runRoute(routing.routes[port][type][msg[1]], msg.data(), msg.size(), val);
+}
+
+// SysEx del panel, leído en el lugar: F0 <header> <botón> [<valor>] F7 (sin valor = apretado)
+void routeSysEx(RoutePort port, const unsigned char* data, size_t size) {
+    const SysexRoutes& sx = routing.sysex[port];
+    size_t h = sx.headerLen;
+    if (h == 0) return;
+    bool match = size >= h + 3 && data[size - 1] == 0xF7 && memcmp(data + 1, sx.header, h) == 0;
+    const unsigned char* body = data + 1 + h;
+    size_t bodyLen = match ? size - 2 - h : 0; // Sin F0, header ni F7
+    if (match && bodyLen <= 2 && sx.buttons[body[0] & 0x7F].action != RouteAction::None) {
+        int val = bodyLen == 2 ? body[1] : 127;
+        runRoute(sx.buttons[body[0] & 0x7F], data, size, val);
+        return;
+    }
+    if (sx.logUnknown) {
+        UnknownSysex u;
+        u.size = (unsigned char)std::min(size, sizeof(u.data));
+        memcpy(u.data, data, u.size);
+        if (!unknownSysex.push(u)) unknownSysexDropped.fetch_add(1, std::memory_order_relaxed);
+    }
 }
 
 // --- CALLBACK STM32 (Maple) ---
 void mapleCallback(double deltatime, std::vector<unsigned char> *message, void *userData) {
+    enterRealtimeThread("Maple");
+    CallbackTimer timer;
+    static double deltaSinceClock = 0; // deltatime acumulado desde el último 0xF8 (timestamps de ALSA)
+    deltaSinceClock += deltatime;
+
     if (message->empty()) return;
+    recorder->record(REC_MAPLE, message->data(), message->size());
     unsigned char status = message->at(0);
 
-    // CLOCK
+#ifdef ELECTONE_WITH_FLUIDSYNTH
+    // Sin FluidSynth externo no hay aconnect Maple -> FLUID: el teclado suena por acá
+    if (fluidSink && status < 0xF0) fluidSink->send(message->data(), message->size());
+#endif
+
+    // CLOCK (con clock interno, el del Maple se ignora)
+    if (internalClock && (status == 0xF8 || status == 0xFA || status == 0xFB || status == 0xFC)) return;
     if (status == 0xF8) {
-        midiOut->sendMessage(message);
+        metrics.clockDelta.record((long long)(deltaSinceClock * 1e9));
+        deltaSinceClock = 0;
+        clockSink->send(message->data(), message->size());
         seq->onClock();
         return;
     }
-    if (status == 0xFA || status == 0xFB) { seq->onStart(); midiOut->sendMessage(message); return; }
-    if (status == 0xFC) { seq->onStop(); midiOut->sendMessage(message); return; }
+    if (status == 0xFA || status == 0xFB) { seq->onStart(); clockSink->send(message->data(), message->size()); return; }
+    if (status == 0xFC) { seq->onStop(); clockSink->send(message->data(), message->size()); return; }
+
+    // PANEL (SysEx): no pasa por la cola de notas ni toca el clock
+    if (status == 0xF0) { routeSysEx(ROUTE_MAPLE, message->data(), message->size()); return; }
 
     // NOTAS INPUT
     if ((status & 0x0F) == CHAN_INPUT_ACOMP) {
@@ -58,66 +284,24 @@ void mapleCallback(double deltatime, std::vector<unsigned char> *message, void *
         else if (type == 0x80 || (type == 0x90 && message->at(2) == 0)) seq->onNoteInput(note, false);
     }
 
-    // CONTROL CHANGE
-    if ((status & 0xF0) == 0xB0) {
-        int cc = message->at(1);
-        int val = message->at(2);
-
-        // --- SELECCIÓN DE SONIDOS (Usando YAML) ---
-
-        // CC 51 -> Lower (Canal 1)
-        if (cc == 51) {
-            if (generalSoundsDB.count(val)) applyPatch(1, generalSoundsDB[val]);
-        }
-        // CC 52 -> Upper (Canal 0)
-        else if (cc == 52) {
-            if (generalSoundsDB.count(val)) applyPatch(0, generalSoundsDB[val]);
-        }
-        // CC 54 -> Lead (Canal 3)
-        else if (cc == 54) {
-            if (leadSoundsDB.count(val)) applyPatch(3, leadSoundsDB[val]);
-        }
-
-        // Control Secuenciador
-        else if (cc == 55) { seq->setStyle(val); }
-        else if (cc == 56) { seq->setVar(val); }
-        else if (cc == 57) { if(val > 0) seq->setFill(val); }
-        else if (cc == 58) { seq->setAcompPattern(val); }
-
-        // Vibrato Lead
-        else if (cc == 17) { sendMidi(0xB0 + 3, 1, val); }
-    }
+    // CONTROLES (routing.yaml)
+    routeMessage(ROUTE_MAPLE, *message);
 }
 
 // --- CALLBACK KORG ---
 void korgCallback(double deltatime, std::vector<unsigned char> *message, void *userData) {
+    enterRealtimeThread("Korg");
+    CallbackTimer timer;
     if (message->size() < 3) return;
-    if ((message->at(0) & 0xF0) != 0xB0) return;
-
-    int cc = message->at(1);
-    int val = message->at(2);
-
-    if (cc == 44 && val == 127) {
-        std::cout << "SHUTDOWN..." << std::endl;
-        system("sudo shutdown -h now");
-    }
-    // Volúmenes
-    else if (cc == 12) { sendMidi(0xB0 + 9, 7, val); } // Drums
-    else if (cc == 3)  { sendMidi(0xB0 + 0, 7, val); } // Upper
-    else if (cc == 2)  { sendMidi(0xB0 + 1, 7, val); } // Lower
-    else if (cc == 4)  { sendMidi(0xB0 + 3, 7, val); } // Lead
-    else if (cc == 6)  { sendMidi(0xB0 + 4, 7, val); } // Acomp (Ch 4 index 5)
-    else if (cc == 27 && val == 127)  { seq->changeOctave(1); }
-    else if (cc == 37 && val == 127)  { seq->changeOctave(-1); }
-
-    else if (cc == 13) {
-        std::vector<unsigned char> sysex = {0xF0, 0x7F, 0x7F, 0x04, 0x01, 0x00, (unsigned char)val, 0xF7};
-        sendSysEx(sysex);
-    }
-    else if (cc == 17) { sendMidi(0xB0 + 3, 1, val); }
+    recorder->record(REC_KORG, message->data(), message->size());
+    routeMessage(ROUTE_KORG, *message);
 }
 
-int main() {
+int main(int argc, char** argv) {
+    // electone_core render / bench: sin puertos de entrada
+    if (argc > 1 && strcmp(argv[1], "render") == 0) return runRender(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) return runBench(argc, argv);
+
     RtMidiIn *mapleIn = 0;
     RtMidiIn *korgIn = 0;
 
@@ -134,11 +318,160 @@ int main() {
         }
         if (!found) midiOut->openVirtualPort("Electone Out");
 
-        // CARGA DE DATOS
-        loadInstrumentDB("sounds.yaml"); // <--- CARGAMOS SONIDOS
-        seq = new Sequencer(midiOut);
-        seq->setDrumDatabase(loadDrumStyles("ritmos.yaml"));
-        seq->setAcompDatabase(loadAcompStyles("chords.yaml"));
+        // OPCIONES DE LÍNEA DE COMANDOS
+        //   --internal-clock [bpm]  el motor genera su propio clock
+        //   --lookahead             el secuenciador agenda cada paso por una cola ALSA (make ALSA_SEQ=1)
+        //   --fluidsynth <sf2>      FluidSynth dentro del proceso (make FLUIDSYNTH=1), con
+        //     --period <frames>       tamaño de período del callback de audio
+        //     --audio-device <dev>    dispositivo ALSA (plughw:3,0 por defecto)
+        //     --fluid-render <wav>    sin placa de sonido: el audio va a un archivo
+        //   --realtime [cpu]        memoria bloqueada y callbacks MIDI en SCHED_FIFO (fijos a 'cpu')
+        //     --rt-priority <1..99>   prioridad SCHED_FIFO (70 por defecto)
+        //   --display <archivo.ppm>  sin panel SPI: la pantalla se vuelca a un PPM
+        //   --record-dir <dir>      dónde van las tomas del grabador (directorio actual por defecto)
+        //   --out <puerto>[:<canales>[:<semitonos>]]  otro destino además del sintetizador, p. ej.
+        //                           --out "UM-ONE:1-4,10:-12" (canales 1..16); se puede repetir
+        double internalBpm = 0;
+        RealtimeConfig rtCfg;
+        bool wantLookahead = false;
+        std::string soundfont, audioDevice, fluidRender, displayFile;
+        std::string recordDir = ".";
+        std::vector<std::string> extraOuts;
+        int periodSize = 0;
+        for (int i = 1; i < argc; i++) {
+            bool hasValue = (i + 1 < argc);
+            if (strcmp(argv[i], "--internal-clock") == 0) {
+                internalBpm = (hasValue && atof(argv[i + 1]) > 0) ? atof(argv[++i]) : 120.0;
+            }
+            else if (strcmp(argv[i], "--lookahead") == 0) wantLookahead = true;
+            else if (strcmp(argv[i], "--fluidsynth") == 0 && hasValue) soundfont = argv[++i];
+            else if (strcmp(argv[i], "--period") == 0 && hasValue) periodSize = atoi(argv[++i]);
+            else if (strcmp(argv[i], "--audio-device") == 0 && hasValue) audioDevice = argv[++i];
+            else if (strcmp(argv[i], "--fluid-render") == 0 && hasValue) fluidRender = argv[++i];
+            else if (strcmp(argv[i], "--realtime") == 0) {
+                rtCfg.enabled = true;
+                if (hasValue && isdigit((unsigned char)argv[i + 1][0])) rtCfg.cpu = atoi(argv[++i]);
+            }
+            else if (strcmp(argv[i], "--rt-priority") == 0 && hasValue) rtCfg.priority = atoi(argv[++i]);
+            else if (strcmp(argv[i], "--display") == 0 && hasValue) displayFile = argv[++i];
+            else if (strcmp(argv[i], "--record-dir") == 0 && hasValue) recordDir = argv[++i];
+            else if (strcmp(argv[i], "--out") == 0 && hasValue) extraOuts.push_back(argv[++i]);
+        }
+        if (rtCfg.priority < 1) rtCfg.priority = 1;
+        if (rtCfg.priority > 99) rtCfg.priority = 99;
+        // Antes de cargar nada ni crear hilos: todo lo que se aloque de acá en más queda bloqueado
+        setupRealtime(rtCfg);
+
+        // CARGA DE DATOS (caché binario si los YAML no cambiaron)
+        EngineData data;
+        loadEngineData("sounds.yaml", "ritmos.yaml", "chords.yaml", CACHE_FILE, data);
+        publishSounds(std::move(data.generalSounds), std::move(data.leadSounds));
+        loadRouting("routing.yaml", routing);
+        registrations.load();
+        rtSink = new RtMidiSink(midiOut);
+        outSink = rtSink;
+        MidiSink* seqSink = rtSink;
+        if (!soundfont.empty()) {
+#ifdef ELECTONE_WITH_FLUIDSYNTH
+            FluidConfig cfg;
+            cfg.soundfont = soundfont;
+            if (periodSize > 0) cfg.periodSize = periodSize;
+            if (!audioDevice.empty()) cfg.audioDevice = audioDevice;
+            cfg.renderFile = fluidRender;
+            fluidSink = new FluidSynthSink(cfg);
+            if (fluidSink->ok()) {
+                outSink = seqSink = fluidSink;
+                fluidSink->startRealtimeRender(); // No hace nada si hay placa de sonido
+                wantLookahead = false;            // No hay cola ALSA de por medio
+            }
+#else
+            std::cerr << "--fluidsynth requiere compilar con FLUIDSYNTH=1" << std::endl;
+            (void)periodSize;
+#endif
+        }
+        if (wantLookahead) {
+#ifdef ELECTONE_WITH_ALSA_SEQ
+            alsaSink = new AlsaSeqSink(PORT_FLUID);
+            if (alsaSink->ok()) seqSink = alsaSink;
+#else
+            std::cerr << "--lookahead requiere compilar con ALSA_SEQ=1" << std::endl;
+#endif
+        }
+
+        // REPARTO: el sintetizador y cada --out con su propio hilo
+        OutputDestination* outDest = new OutputDestination("Sintetizador", outSink);
+        OutputDestination* seqDest = outDest;
+        outputs.push_back(outDest);
+        if (seqSink != outSink) {
+            seqDest = new OutputDestination("Sintetizador (lookahead)", seqSink);
+            outputs.push_back(seqDest);
+        }
+        seqFanout = new OutputFanout();
+        outFanout = new OutputFanout();
+        seqFanout->add(seqDest);
+        outFanout->add(outDest);
+        for (const std::string& spec : extraOuts) {
+            std::string portName;
+            OutputFilter filter;
+            if (!parseOutputSpec(spec, portName, filter)) {
+                std::cerr << "--out inválido: " << spec << std::endl;
+                continue;
+            }
+            RtMidiOut* port = new RtMidiOut();
+            bool opened = false;
+            for (unsigned i = 0; i < port->getPortCount(); i++) {
+                if (port->getPortName(i).find(portName) != std::string::npos) {
+                    port->openPort(i);
+                    std::cout << "Output: " << port->getPortName(i) << std::endl;
+                    opened = true;
+                    break;
+                }
+            }
+            if (!opened) {
+                std::cerr << "Output: no se encontró el puerto " << portName << std::endl;
+                delete port;
+                continue;
+            }
+            extraPorts.push_back(port);
+            extraSinks.push_back(new RtMidiSink(port));
+            OutputDestination* d = new OutputDestination(portName, extraSinks.back(), filter);
+            outputs.push_back(d);
+            seqFanout->add(d);
+            outFanout->add(d);
+        }
+        for (OutputDestination* d : outputs) d->start();
+        clockSink = outFanout;
+
+        recorder = new Recorder(recordDir);
+        recorder->start();
+        seqRecSink = new RecordingSink(seqFanout, recorder, REC_SEQUENCER);
+        outRecSink = new RecordingSink(outFanout, recorder, REC_OUTPUT);
+        outSink = outRecSink;
+        seq = new Sequencer(seqRecSink);
+        seq->publishDatabases(std::move(data.drums), std::move(data.acomps));
+
+        // Recarga en caliente: editar un YAML no requiere reiniciar
+        watcher = new BankWatcher(".", {"sounds.yaml", "ritmos.yaml", "chords.yaml"}, [](EngineData& d) {
+            publishSounds(std::move(d.generalSounds), std::move(d.leadSounds));
+            seq->publishDatabases(std::move(d.drums), std::move(d.acomps));
+            std::cout << "YAML recargados (los ritmos entran en el próximo compás)" << std::endl;
+        });
+        watcher->start();
+        if (wantLookahead) {
+            if (seq->setLookahead(true)) std::cout << "Lookahead: ON" << std::endl;
+            else if (!extraOuts.empty()) std::cout << "Lookahead: OFF (los --out no agendan)" << std::endl;
+        }
+
+        if (!displayFile.empty()) {
+            displaySink = new FileDisplaySink(displayFile);
+            display = new PanelDisplay(seq, displaySink);
+            display->start();
+        }
+
+        if (internalBpm > 0) {
+            internalClock = new InternalClock(seq, clockSink, internalBpm);
+            std::cout << "Clock interno: " << internalClock->getBpm() << " BPM" << std::endl;
+        }
 
         mapleIn = new RtMidiIn();
         korgIn = new RtMidiIn();
@@ -164,17 +497,57 @@ int main() {
             }
         }
 
+        signal(SIGUSR1, onSigUsr1);
+
         std::cout << ">>> ELECTONE C++ ENGINE RUNNING <<<" << std::endl;
 
-        while(true) std::this_thread::sleep_for(std::chrono::seconds(1));
+        bool clockLocked = false;
+        while(true) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+            // Enganche del clock: se informa desde acá, el hilo del clock no imprime
+            ClockEstimate ce = seq->clockEstimate();
+            bool locked = ce.locked && monoNowNs() < ce.nextTickNs + (long long)(4 * ce.periodNs);
+            if (locked != clockLocked) {
+                clockLocked = locked;
+                if (locked) std::cout << "Clock: enganchado a " << (int)(60e9 / (ce.periodNs * PPQN) + 0.5) << " BPM" << std::endl;
+                else std::cout << "Clock: perdido" << std::endl;
+            }
+
+            if (dumpRequested.exchange(false)) dumpAllStats();
+            printUnknownSysex();
+            if (internalClock) internalClock->reap();
+            freeRetiredSounds();
+            registrations.saveIfDirty();
+        }
 
     } catch (RtMidiError &error) {
         error.printMessage();
     }
 
+    delete watcher;
+    delete display;
+    delete displaySink;
+    delete internalClock;
     delete mapleIn;
     delete korgIn;
+    freeRetiredSounds(); // Ya no queda ningún callback leyendo
     delete seq;
+    for (OutputDestination* d : outputs) delete d; // Manda lo que quedó en cada cola
+    delete seqFanout;
+    delete outFanout;
+    for (RtMidiSink* s : extraSinks) delete s;
+    for (RtMidiOut* p : extraPorts) delete p;
+#ifdef ELECTONE_WITH_ALSA_SEQ
+    delete alsaSink;
+#endif
+#ifdef ELECTONE_WITH_FLUIDSYNTH
+    delete fluidSink;
+#endif
+    delete seqRecSink;
+    delete outRecSink;
+    delete recorder; // Cierra la toma en curso
+    delete rtSink;
     delete midiOut;
     return 0;
 }
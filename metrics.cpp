@@ -0,0 +1,106 @@
+#include "electone.h"
+#include <time.h>
+#include <iomanip>
+#include <sstream>
+
+Metrics metrics;
+
+long long monoNowNs() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (long long)t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+// --- HISTOGRAMA ---
+// 4 sub-buckets por octava: el bucket cubre [(4+sub) << (oct-2), (5+sub) << (oct-2)) ns
+static inline int bucketOf(long long ns) {
+    int oct = 63 - __builtin_clzll((unsigned long long)ns);
+    int sub = (int)((ns >> (oct - 2)) & 3);
+    return (oct - 2) * 4 + sub;
+}
+static inline double bucketLow(int i) { return (double)((4ULL + i % 4) << (i / 4)); }
+static inline double bucketHigh(int i) { return (double)((5ULL + i % 4) << (i / 4)); }
+
+void LatencyHistogram::record(long long ns) {
+    if (ns < 4) ns = 4;
+    int b = bucketOf(ns);
+    if (b >= BUCKETS) b = BUCKETS - 1;
+    buckets[b].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sumNs.fetch_add(ns, std::memory_order_relaxed);
+    long long prev = maxNs.load(std::memory_order_relaxed);
+    while (ns > prev && !maxNs.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {}
+}
+
+void LatencyHistogram::reset() {
+    for (auto& b : buckets) b.store(0, std::memory_order_relaxed);
+    count = 0; sumNs = 0; maxNs = 0;
+}
+
+static std::string fmtNs(double ns) {
+    std::ostringstream os;
+    os << std::fixed << std::setprecision(1);
+    if (ns < 1e3) os << ns << " ns";
+    else if (ns < 1e6) os << ns / 1e3 << " us";
+    else os << ns / 1e6 << " ms";
+    return os.str();
+}
+
+void LatencyHistogram::dump(std::ostream& os) const {
+    unsigned long n = count.load();
+    os << name << ": " << n << " muestras";
+    if (n == 0) { os << std::endl; return; }
+    os << ", media " << fmtNs((double)sumNs.load() / n) << ", máx " << fmtNs((double)maxNs.load()) << std::endl;
+
+    // Percentiles aproximados por el techo del bucket
+    const double pct[] = {0.50, 0.99, 0.999};
+    unsigned long acc = 0;
+    int p = 0;
+    os << "   ";
+    for (int i = 0; i < BUCKETS && p < 3; i++) {
+        acc += buckets[i].load();
+        while (p < 3 && acc >= pct[p] * n) {
+            os << " p" << pct[p] * 100 << " < " << fmtNs(bucketHigh(i));
+            p++;
+        }
+    }
+    os << std::endl;
+    for (int i = 0; i < BUCKETS; i++) {
+        unsigned long c = buckets[i].load();
+        if (c == 0) continue;
+        os << "    [" << std::setw(9) << fmtNs(bucketLow(i)) << ", " << std::setw(9) << fmtNs(bucketHigh(i))
+           << "): " << c << std::endl;
+    }
+}
+
+// --- LATENCIA CALLBACK -> SALIDA ---
+static thread_local long long callbackEntryNs = 0;
+
+CallbackTimer::CallbackTimer() { callbackEntryNs = monoNowNs(); }
+CallbackTimer::~CallbackTimer() { callbackEntryNs = 0; }
+
+void markOutputSent() {
+    if (callbackEntryNs == 0) return;
+    metrics.callbackLatency.record(monoNowNs() - callbackEntryNs);
+    callbackEntryNs = 0; // Solo el primer envío de cada callback
+}
+
+long long takeCallbackEntry() {
+    long long t = callbackEntryNs;
+    callbackEntryNs = 0;
+    return t;
+}
+
+void recordCallbackLatency(long long entryNs) {
+    if (entryNs != 0) metrics.callbackLatency.record(monoNowNs() - entryNs);
+}
+
+void dumpMetrics(std::ostream& os) {
+    os << "===== MÉTRICAS =====" << std::endl;
+    metrics.callbackLatency.dump(os);
+    metrics.clockInterval.dump(os);
+    metrics.clockDelta.dump(os);
+    metrics.clockPhaseError.dump(os);
+    metrics.onClockTime.dump(os);
+    metrics.audioCallback.dump(os);
+}
@@ -0,0 +1,91 @@
+#include "electone.h"
+#include <cstdlib>
+#include <new>
+
+// --- BUFFER DE SALIDA ---
+MidiOutBuffer::MidiOutBuffer(MidiSink* s) : sink(nullptr), batched(false) { setSink(s); }
+
+void MidiOutBuffer::setSink(MidiSink* s) {
+    flush();
+    sink = s;
+    batched = s && s->acceptsStream();
+}
+
+// Si no entra el próximo mensaje, mandamos lo que hay (nunca se pierde nada)
+void MidiOutBuffer::reserve(size_t bytes) {
+    if (len + bytes > CAPACITY || count >= MAX_MESSAGES) flush();
+}
+
+// En modo batched el status se omite si repite el anterior (running status)
+void MidiOutBuffer::putStatus(unsigned char status) {
+    if (batched) {
+        if (status != lastStatus) buf[len++] = status;
+        lastStatus = status;
+    } else {
+        starts[count++] = (unsigned short)len;
+        buf[len++] = status;
+    }
+}
+
+void MidiOutBuffer::add(unsigned char status, unsigned char d1) {
+    reserve(2);
+    putStatus(status);
+    buf[len++] = d1;
+    messages++;
+}
+
+void MidiOutBuffer::add(unsigned char status, unsigned char d1, unsigned char d2) {
+    reserve(3);
+    // Note off como note on con velocidad 0: así las notas de un canal comparten status
+    if (batched && (status & 0xF0) == 0x80) { status = 0x90 | (status & 0x0F); d2 = 0; }
+    putStatus(status);
+    buf[len++] = d1;
+    buf[len++] = d2;
+    messages++;
+}
+
+void MidiOutBuffer::flush(long long delayNs) {
+    if (len == 0 || !sink) { len = 0; count = 0; lastStatus = 0; return; }
+    if (batched) {
+        sink->send(buf, len, delayNs);
+        sends++;
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            size_t end = (i + 1 < count) ? starts[i + 1] : len;
+            sink->send(buf + starts[i], end - starts[i], delayNs);
+            sends++;
+        }
+    }
+    len = 0;
+    count = 0;
+    lastStatus = 0;
+    markOutputSent();
+}
+
+size_t midiMessageLength(const unsigned char* p, size_t avail, unsigned char status) {
+    if (status == 0xF0) {
+        size_t n = 1;
+        while (n < avail && p[n - 1] != 0xF7) n++;
+        return n;
+    }
+    if (status < 0xF0) return ((status & 0xF0) == 0xC0 || (status & 0xF0) == 0xD0) ? 2 : 3;
+    if (status == 0xF1 || status == 0xF3) return 2;
+    return status == 0xF2 ? 3 : 1;
+}
+
+// --- CONTADOR DE ALOCACIONES ---
+#ifdef ELECTONE_COUNT_ALLOCS
+static std::atomic<unsigned long> heapAllocs{0};
+
+void* operator new(size_t size) {
+    heapAllocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+unsigned long heapAllocCount() { return heapAllocs.load(std::memory_order_relaxed); }
+#else
+unsigned long heapAllocCount() { return 0; }
+#endif
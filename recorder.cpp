@@ -0,0 +1,138 @@
+#include "electone.h"
+#include <chrono>
+#include <ctime>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// --- GRABADOR DE TOMAS ---
+// Inicio y fin de toma viajan por el mismo anillo que los mensajes (source = REC_SOURCES),
+// así el escritor los ve en orden sin tener que coordinar nada más.
+
+static const char* const TRACK_NAMES[REC_SOURCES] = { "Teclado (Maple)", "nanoKONTROL", "Secuenciador", "Sonidos y controles" };
+
+Recorder::Recorder(const std::string& dir) : dir(dir) {}
+
+Recorder::~Recorder() { stop(); }
+
+void Recorder::start() {
+    if (running.exchange(true)) return;
+    worker = std::thread(&Recorder::run, this);
+}
+
+void Recorder::stop() {
+    if (recording.load()) toggleTake();
+    if (!running.exchange(false)) return;
+    if (worker.joinable()) worker.join();
+}
+
+bool Recorder::pushMark(bool begin) {
+    RecEvent ev = {};
+    ev.timeNs = monoNowNs();
+    ev.source = REC_SOURCES;
+    ev.data[0] = begin ? 1 : 0;
+    if (ring.push(ev)) return true;
+    overruns.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void Recorder::toggleTake() {
+    if (toggling.exchange(true, std::memory_order_acquire)) return; // Ya lo está cambiando otro callback
+    if (!recording.load(std::memory_order_relaxed)) {
+        // La marca va antes que el primer mensaje de la toma
+        if (pushMark(true)) recording.store(true, std::memory_order_release);
+    } else {
+        // Y después del último
+        recording.store(false, std::memory_order_release);
+        if (!pushMark(false)) recording.store(true, std::memory_order_release);
+    }
+    toggling.store(false, std::memory_order_release);
+}
+
+void Recorder::record(RecSource source, const unsigned char* data, size_t size, long long delayNs) {
+    if (!recording.load(std::memory_order_relaxed)) return;
+    long long t = monoNowNs() + (delayNs > 0 ? delayNs : 0);
+
+    unsigned char status = 0;
+    size_t i = 0;
+    while (i < size) {
+        RecEvent ev;
+        ev.timeNs = t;
+        ev.source = (unsigned char)source;
+        size_t len;
+        if (data[i] >= 0x80) {
+            if (data[i] >= 0xF8) { i++; continue; } // Tiempo real: no se graba
+            status = data[i];
+            len = midiMessageLength(data + i, size - i, status);
+            if (i + len > size) break;
+            if (len > sizeof(ev.data)) { skipped.fetch_add(1, std::memory_order_relaxed); i += len; continue; }
+            ev.size = (unsigned char)len;
+            memcpy(ev.data, data + i, len);
+        } else {
+            if (status == 0 || status >= 0xF0) break; // Datos sueltos: el stream está roto
+            len = midiMessageLength(data + i, size - i, status) - 1; // Running status: sin el byte de status
+            if (i + len > size) break;
+            ev.size = (unsigned char)(len + 1);
+            ev.data[0] = status;
+            memcpy(ev.data + 1, data + i, len);
+        }
+        i += len;
+        if (ring.push(ev)) events.fetch_add(1, std::memory_order_relaxed);
+        else overruns.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+RecorderStats Recorder::stats() const {
+    return { events.load(std::memory_order_relaxed), overruns.load(std::memory_order_relaxed),
+             skipped.load(std::memory_order_relaxed), takes.load(std::memory_order_relaxed), isRecording() };
+}
+
+// --- HILO ESCRITOR ---
+void Recorder::run() {
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 10);
+
+    std::vector<SmfTrack> tracks(REC_SOURCES);
+    for (int s = 0; s < REC_SOURCES; s++) tracks[s].name = TRACK_NAMES[s];
+    bool active = false;
+    long long startNs = 0;
+
+    auto finish = [&]() {
+        for (SmfTrack& tr : tracks) {
+            // Lo agendado con lookahead entra antes de sonar: se ordena por tiempo
+            std::stable_sort(tr.events.begin(), tr.events.end(), [](const SmfEvent& a, const SmfEvent& b) { return a.tick < b.tick; });
+        }
+        char name[64];
+        time_t now = time(nullptr);
+        tm local;
+        localtime_r(&now, &local);
+        strftime(name, sizeof(name), "toma-%Y%m%d-%H%M%S.mid", &local);
+        std::string path = dir + "/" + name;
+        size_t n = 0;
+        for (const SmfTrack& tr : tracks) n += tr.events.size();
+        if (writeSmf(path, tracks, DIVISION, 120.0)) {
+            takes.fetch_add(1, std::memory_order_relaxed);
+            std::cout << "Grabación: " << path << " (" << n << " mensajes)" << std::endl;
+        }
+        for (SmfTrack& tr : tracks) tr.events.clear();
+    };
+
+    for (;;) {
+        bool keepGoing = running.load(std::memory_order_relaxed);
+        RecEvent ev;
+        while (ring.pop(ev)) {
+            if (ev.source == REC_SOURCES) {
+                if (active) finish();
+                active = ev.data[0] != 0;
+                startNs = ev.timeNs;
+                continue;
+            }
+            if (!active) continue; // Llegó después de cortar la toma
+            long long ns = ev.timeNs - startNs;
+            unsigned long tick = ns > 0 ? (unsigned long)(ns / 1000000) : 0;
+            tracks[ev.source].events.push_back({ tick, std::vector<unsigned char>(ev.data, ev.data + ev.size) });
+        }
+        if (!keepGoing) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    if (active) finish();
+}
@@ -0,0 +1,288 @@
+#include "electone.h"
+#include <yaml-cpp/yaml.h>
+#include <fstream>
+#include <stdexcept>
+#include <cstdio>
+
+// --- ESTADO MANDADO POR CANAL ---
+static std::atomic<signed char> sentState[16][5]; // bank, program, portamento, portamentoTime, volume
+static std::atomic<short> selectedSounds[16];
+static struct ChannelStateInit {
+    ChannelStateInit() {
+        for (auto& ch : sentState)
+            for (auto& f : ch) f.store(-1, std::memory_order_relaxed);
+        for (auto& s : selectedSounds) s.store(-1, std::memory_order_relaxed);
+    }
+} channelStateInit;
+
+static signed char ChannelTarget::* const FIELDS[5] = {
+    &ChannelTarget::bank, &ChannelTarget::program, &ChannelTarget::portamento, &ChannelTarget::portamentoTime, &ChannelTarget::volume,
+};
+
+static std::atomic<unsigned long> deltaSent{0};
+static std::atomic<unsigned long> deltaSkipped{0};
+
+ChannelTarget patchTarget(const SoundPatch& patch) {
+    ChannelTarget t;
+    t.bank = (signed char)(patch.bank & 0x7F);
+    t.program = (signed char)(patch.program & 0x7F);
+    t.portamento = patch.portamento ? 127 : 0;
+    if (patch.portamento) t.portamentoTime = (signed char)(patch.portamentoTime & 0x7F);
+    return t;
+}
+
+void noteChannelSent(int channel, const ChannelTarget& t) {
+    if (channel < 0 || channel >= 16) return;
+    for (int f = 0; f < 5; f++)
+        if (t.*FIELDS[f] >= 0) sentState[channel][f].store(t.*FIELDS[f], std::memory_order_relaxed);
+}
+
+void noteControlSent(int channel, int cc, int value) {
+    ChannelTarget t;
+    signed char v = (signed char)(value & 0x7F);
+    switch (cc) {
+    case 0: t.bank = v; break;
+    case 5: t.portamentoTime = v; break;
+    case 7: t.volume = v; break;
+    case 65: t.portamento = v; break;
+    default: return;
+    }
+    noteChannelSent(channel, t);
+}
+
+void forgetChannelsSent() {
+    for (auto& ch : sentState)
+        for (auto& f : ch) f.store(-1, std::memory_order_relaxed);
+}
+
+ChannelTarget channelSent(int channel) {
+    ChannelTarget t;
+    for (int f = 0; f < 5; f++) t.*FIELDS[f] = sentState[channel][f].load(std::memory_order_relaxed);
+    return t;
+}
+
+int addChannelDelta(MidiOutBuffer& buf, int channel, const ChannelTarget& t) {
+    ChannelTarget cur = channelSent(channel);
+    int wanted = 0, added = 0;
+    for (int f = 0; f < 5; f++) if (t.*FIELDS[f] >= 0) wanted++;
+
+    bool bankChanged = t.bank >= 0 && t.bank != cur.bank;
+    if (bankChanged) { buf.add(0xB0 + channel, 0, t.bank); added++; }
+    // El bank select recién se aplica con el program change que le sigue
+    if (t.program >= 0 && (bankChanged || t.program != cur.program)) { buf.add(0xC0 + channel, t.program); added++; }
+    if (t.portamento >= 0 && t.portamento != cur.portamento) { buf.add(0xB0 + channel, 65, t.portamento); added++; }
+    if (t.portamentoTime >= 0 && t.portamentoTime != cur.portamentoTime) { buf.add(0xB0 + channel, 5, t.portamentoTime); added++; }
+    if (t.volume >= 0 && t.volume != cur.volume) { buf.add(0xB0 + channel, 7, t.volume); added++; }
+
+    noteChannelSent(channel, t);
+    deltaSent.fetch_add(added, std::memory_order_relaxed);
+    deltaSkipped.fetch_add(wanted - added, std::memory_order_relaxed);
+    return added;
+}
+
+void noteSelectedSound(int channel, int sound) {
+    if (channel >= 0 && channel < 16) selectedSounds[channel].store((short)sound, std::memory_order_relaxed);
+}
+
+int selectedSound(int channel) { return selectedSounds[channel].load(std::memory_order_relaxed); }
+
+// --- REGISTRACIONES ---
+struct RegPart {
+    const char* name;
+    int channel;
+    bool lead; // Sonido de lead_sounds
+};
+static const RegPart SOUND_PARTS[] = { { "upper", 0, false }, { "lower", 1, false }, { "lead", 3, true } };
+static const RegPart VOLUME_PARTS[] = {
+    { "upper", 0, false }, { "lower", 1, false }, { "lead", 3, false }, { "acomp", CHAN_OUT_ACOMP, false }, { "drums", CHAN_OUT_DRUMS, false },
+};
+
+static const char* const FILE_HEADER =
+    "# Registraciones: banco (1..4) -> memoria (1..8) -> estado del panel\n"
+    "#   upper, lower, lead          id de sounds.yaml (lead: de lead_sounds)\n"
+    "#   volume: { upper, lower, lead, acomp, drums }   0..127\n"
+    "#   style, variation, acomp-pattern, octave (-3..3)\n"
+    "# Lo que no figura queda como está. Al recuperar solo se manda lo que cambia, al\n"
+    "# empezar el próximo compás. El motor reescribe este archivo al guardar desde el panel.\n";
+
+static int checkedInt(const YAML::Node& n, int lo, int hi, const std::string& where) {
+    int v = n.as<int>();
+    if (v < lo || v > hi) throw std::runtime_error(where + " fuera de rango (" + std::to_string(v) + ")");
+    return v;
+}
+
+static Registration parseRegistration(const YAML::Node& node, const std::string& where) {
+    Registration r;
+    r.valid = true;
+    for (const RegPart& p : SOUND_PARTS)
+        if (node[p.name]) r.sound[p.channel] = (short)checkedInt(node[p.name], 0, 32767, where + ": " + p.name);
+    if (YAML::Node vol = node["volume"]) {
+        for (const RegPart& p : VOLUME_PARTS)
+            if (vol[p.name]) r.volume[p.channel] = (signed char)checkedInt(vol[p.name], 0, 127, where + ": volume " + p.name);
+    }
+    if (node["style"]) r.style = (short)checkedInt(node["style"], 0, 32767, where + ": style");
+    if (node["variation"]) r.var = (short)checkedInt(node["variation"], 0, 32767, where + ": variation");
+    if (node["acomp-pattern"]) r.acompPattern = (short)checkedInt(node["acomp-pattern"], 0, 32767, where + ": acomp-pattern");
+    if (node["octave"]) {
+        r.setOctave = true;
+        r.octave = (signed char)checkedInt(node["octave"], -3, 3, where + ": octave");
+    }
+    return r;
+}
+
+bool RegistrationMemory::load() {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto& b : regs) for (Registration& r : b) r = Registration();
+    std::ifstream probe(path);
+    if (!probe) return true; // Sin archivo todavía: se crea al guardar la primera
+    try {
+        std::cout << "Cargando Registraciones: " << path << std::endl;
+        YAML::Node config = YAML::LoadFile(path);
+        int count = 0;
+        for (const auto& bankNode : config) {
+            std::string bw = "banco " + bankNode.first.as<std::string>();
+            int b = checkedInt(bankNode.first, 1, REG_BANKS, bw);
+            for (const auto& memNode : bankNode.second) {
+                std::string where = bw + " memoria " + memNode.first.as<std::string>();
+                int m = checkedInt(memNode.first, 1, REG_MEMORIES, where);
+                regs[b - 1][m - 1] = parseRegistration(memNode.second, where);
+                count++;
+            }
+        }
+        std::cout << "  -> " << count << " memorias." << std::endl;
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Error Registraciones: " << e.what() << std::endl;
+        for (auto& b : regs) for (Registration& r : b) r = Registration();
+        return false;
+    }
+}
+
+bool RegistrationMemory::saveIfDirty() {
+    if (!dirty.exchange(false)) return true;
+    Registration copy[REG_BANKS][REG_MEMORIES];
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        std::copy(&regs[0][0], &regs[0][0] + REG_BANKS * REG_MEMORIES, &copy[0][0]);
+    }
+
+    YAML::Emitter em;
+    em << YAML::BeginMap;
+    for (int b = 0; b < REG_BANKS; b++) {
+        bool any = false;
+        for (const Registration& r : copy[b]) any |= r.valid;
+        if (!any) continue;
+        em << YAML::Key << b + 1 << YAML::Value << YAML::BeginMap;
+        for (int m = 0; m < REG_MEMORIES; m++) {
+            const Registration& r = copy[b][m];
+            if (!r.valid) continue;
+            em << YAML::Key << m + 1 << YAML::Value << YAML::Flow << YAML::BeginMap;
+            for (const RegPart& p : SOUND_PARTS)
+                if (r.sound[p.channel] >= 0) em << YAML::Key << p.name << YAML::Value << r.sound[p.channel];
+            bool anyVolume = false;
+            for (const RegPart& p : VOLUME_PARTS) anyVolume |= r.volume[p.channel] >= 0;
+            if (anyVolume) {
+                em << YAML::Key << "volume" << YAML::Value << YAML::BeginMap;
+                for (const RegPart& p : VOLUME_PARTS)
+                    if (r.volume[p.channel] >= 0) em << YAML::Key << p.name << YAML::Value << (int)r.volume[p.channel];
+                em << YAML::EndMap;
+            }
+            if (r.style >= 0) em << YAML::Key << "style" << YAML::Value << r.style;
+            if (r.var >= 0) em << YAML::Key << "variation" << YAML::Value << r.var;
+            if (r.acompPattern >= 0) em << YAML::Key << "acomp-pattern" << YAML::Value << r.acompPattern;
+            if (r.setOctave) em << YAML::Key << "octave" << YAML::Value << (int)r.octave;
+            em << YAML::EndMap;
+        }
+        em << YAML::EndMap;
+    }
+    em << YAML::EndMap;
+
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream f(tmp);
+        if (!f) {
+            std::cerr << "Error Registraciones: no se pudo escribir " << tmp << std::endl;
+            dirty = true;
+            return false;
+        }
+        f << FILE_HEADER << "\n" << em.c_str() << "\n";
+    }
+    if (rename(tmp.c_str(), path.c_str()) != 0) {
+        dirty = true;
+        return false;
+    }
+    return true;
+}
+
+void RegistrationMemory::selectBank(int b) {
+    if (b < 1 || b > REG_BANKS) return;
+    bank.store(b - 1, std::memory_order_relaxed);
+    std::cout << "Registraciones: banco " << b << std::endl;
+}
+
+void RegistrationMemory::armStore() {
+    storeArmed = true;
+    std::cout << "Registraciones: elegí la memoria donde guardar" << std::endl;
+}
+
+// Se resuelve contra el banco de sonidos vigente (en el callback, donde ya se leen los
+// maps): el secuenciador recibe solo bytes
+static CompiledRegistration resolve(const Registration& r) {
+    CompiledRegistration c;
+    SoundsRef sounds = currentSounds();
+    for (const RegPart& p : SOUND_PARTS) {
+        if (r.sound[p.channel] < 0) continue;
+        const std::map<int, SoundPatch>& db = p.lead ? sounds->lead : sounds->general;
+        auto it = db.find(r.sound[p.channel]);
+        if (it != db.end()) c.channels[p.channel] = patchTarget(it->second);
+    }
+    for (const RegPart& p : VOLUME_PARTS) c.channels[p.channel].volume = r.volume[p.channel];
+    c.style = r.style;
+    c.var = r.var;
+    c.acompPattern = r.acompPattern;
+    c.setOctave = r.setOctave;
+    c.octave = r.octave;
+    return c;
+}
+
+void RegistrationMemory::press(int memory, Sequencer* seq) {
+    if (memory < 1 || memory > REG_MEMORIES) return;
+    int b = bank.load(std::memory_order_relaxed);
+
+    if (storeArmed.exchange(false)) {
+        Registration r;
+        r.valid = true;
+        for (const RegPart& p : SOUND_PARTS) r.sound[p.channel] = (short)selectedSound(p.channel);
+        for (const RegPart& p : VOLUME_PARTS) r.volume[p.channel] = channelSent(p.channel).volume;
+        PanelState st = seq->panelState();
+        r.style = st.style;
+        r.var = st.var;
+        r.acompPattern = st.acompPattern;
+        r.setOctave = true;
+        r.octave = (signed char)st.octave;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            regs[b][memory - 1] = r;
+        }
+        dirty = true; // Lo escribe el loop principal
+        stores.fetch_add(1, std::memory_order_relaxed);
+        std::cout << "Registraciones: guardada en banco " << b + 1 << ", memoria " << memory << std::endl;
+        return;
+    }
+
+    Registration r;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        r = regs[b][memory - 1];
+    }
+    if (!r.valid) return;
+    seq->recallRegistration(resolve(r));
+    for (const RegPart& p : SOUND_PARTS)
+        if (r.sound[p.channel] >= 0) noteSelectedSound(p.channel, r.sound[p.channel]);
+    recalls.fetch_add(1, std::memory_order_relaxed);
+}
+
+RegistrationStats RegistrationMemory::stats() const {
+    return { recalls.load(std::memory_order_relaxed), stores.load(std::memory_order_relaxed),
+             deltaSent.load(std::memory_order_relaxed), deltaSkipped.load(std::memory_order_relaxed) };
+}
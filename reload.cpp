@@ -0,0 +1,81 @@
+#include "electone.h"
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <climits>
+#include <chrono>
+
+// --- RECARGA EN CALIENTE ---
+// Un hilo de baja prioridad mira el directorio de los YAML (los editores suelen guardar
+// con rename, por eso se mira el directorio y no el archivo), espera a que dejen de
+// escribir, recompila en este hilo y publica el resultado con onReload.
+
+BankWatcher::BankWatcher(const std::string& dir, std::vector<std::string> files, std::function<void(EngineData&)> onReload)
+    : dir(dir), files(std::move(files)), onReload(std::move(onReload)) {}
+
+BankWatcher::~BankWatcher() { stop(); }
+
+bool BankWatcher::start() {
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        std::cerr << "Error inotify: no se puede mirar " << dir << std::endl;
+        if (fd >= 0) close(fd);
+        fd = -1;
+        return false;
+    }
+    running = true;
+    worker = std::thread(&BankWatcher::run, this);
+    return true;
+}
+
+void BankWatcher::stop() {
+    if (!running.exchange(false)) return;
+    if (worker.joinable()) worker.join();
+    close(fd);
+    fd = -1;
+}
+
+// Devuelve true si alguno de los eventos leídos toca uno de nuestros archivos
+bool BankWatcher::readEvents() {
+    alignas(struct inotify_event) char buf[4096];
+    bool relevant = false;
+    for (;;) {
+        ssize_t len = read(fd, buf, sizeof(buf));
+        if (len <= 0) break;
+        for (char* p = buf; p < buf + len;) {
+            struct inotify_event* ev = (struct inotify_event*)p;
+            if (ev->len > 0) {
+                for (const std::string& f : files) if (f == ev->name) relevant = true;
+            }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    return relevant;
+}
+
+void BankWatcher::run() {
+    const int DEBOUNCE_MS = 300; // Los editores escriben en varias tandas
+    bool dirty = false;
+    auto lastChange = std::chrono::steady_clock::now();
+
+    while (running.load()) {
+        pollfd pfd = { fd, POLLIN, 0 };
+        int r = poll(&pfd, 1, 100);
+        if (r > 0 && (pfd.revents & POLLIN) && readEvents()) {
+            dirty = true;
+            lastChange = std::chrono::steady_clock::now();
+        }
+        if (!dirty) continue;
+        if (std::chrono::steady_clock::now() - lastChange < std::chrono::milliseconds(DEBOUNCE_MS)) continue;
+        dirty = false;
+
+        std::cout << "Recargando YAML..." << std::endl;
+        EngineData data;
+        std::string prefix = dir + "/";
+        if (loadEngineData(prefix + files[0], prefix + files[1], prefix + files[2], prefix + CACHE_FILE, data) == EngineLoad::Error) {
+            std::cerr << "YAML con errores: sigue sonando el banco anterior" << std::endl;
+            continue;
+        }
+        onReload(data);
+    }
+}
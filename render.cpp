@@ -0,0 +1,195 @@
+#include "electone.h"
+#include <cstring>
+#include <sstream>
+#include <chrono>
+
+// --- RENDER SIN TECLADO ---
+// electone_core render [opciones]: maneja Sequencer::onClock lo más rápido posible
+// contra un destino en memoria y escribe un .mid (y un .wav si hay FluidSynth).
+
+// Destino en memoria: guarda cada mensaje con el tick actual y opcionalmente lo reenvía
+class CaptureSink : public MidiSink {
+public:
+    unsigned long tick = 0;
+    MidiSink* forward = nullptr;
+    std::vector<SmfEvent> events;
+
+    void send(const unsigned char* data, size_t size, long long delayNs = 0) override {
+        events.push_back({tick, std::vector<unsigned char>(data, data + size)});
+        if (forward) forward->send(data, size);
+    }
+};
+
+struct RenderOptions {
+    int style = 0;
+    int var = 0;
+    int acomp = 0;
+    int bars = 4;
+    double bpm = 120.0;
+    std::vector<std::vector<int>> chords; // Un acorde por compás, en loop
+    std::string out = "render.mid";
+    std::string wav;
+    std::string soundfont;
+    std::string allDir;                   // Si no está vacío: todos los estilos a este directorio
+    std::string ritmosFile = "ritmos.yaml";
+    std::string chordsFile = "chords.yaml";
+};
+
+static void printUsage() {
+    std::cout << "Uso: electone_core render [opciones]\n"
+                 "  --style N --var N --acomp N   estilo, variación y patrón de acompañamiento (0)\n"
+                 "  --chords 60-64-67,57-60-64    acordes sostenidos, uno por compás, en loop (C mayor)\n"
+                 "  --bars N                      compases a renderizar (4)\n"
+                 "  --bpm N                       tempo del archivo (120)\n"
+                 "  --out archivo.mid             salida MIDI (render.mid)\n"
+                 "  --wav archivo.wav             además audio (requiere --soundfont y FLUIDSYNTH=1)\n"
+                 "  --soundfont archivo.sf2\n"
+                 "  --all DIR                     todas las variaciones x patrones de todos los estilos\n"
+                 "  --ritmos / --chords-file      YAML alternativos" << std::endl;
+}
+
+static std::vector<std::vector<int>> parseChords(const std::string& text) {
+    std::vector<std::vector<int>> chords;
+    std::stringstream all(text);
+    std::string chord;
+    while (std::getline(all, chord, ',')) {
+        std::vector<int> notes;
+        std::stringstream cs(chord);
+        std::string n;
+        while (std::getline(cs, n, '-')) if (!n.empty()) notes.push_back(std::stoi(n));
+        if (!notes.empty()) chords.push_back(notes);
+    }
+    return chords;
+}
+
+// Una pista por canal, ordenadas por canal (SysEx y otros van en la primera)
+static std::vector<SmfTrack> splitByChannel(const std::vector<SmfEvent>& events) {
+    std::map<int, SmfTrack> byChannel;
+    for (const SmfEvent& ev : events) {
+        int ch = (ev.data[0] < 0xF0) ? (ev.data[0] & 0x0F) : -1;
+        byChannel[ch].events.push_back(ev);
+    }
+    std::vector<SmfTrack> tracks;
+    for (auto& [ch, tr] : byChannel) {
+        if (ch == CHAN_OUT_DRUMS) tr.name = "Ritmo";
+        else if (ch == CHAN_OUT_ACOMP) tr.name = "Acomp";
+        else if (ch >= 0) tr.name = "Canal " + std::to_string(ch + 1);
+        tracks.push_back(std::move(tr));
+    }
+    return tracks;
+}
+
+static bool renderOne(const std::map<int, DrumStyle>& drums, const std::map<int, AcompStyle>& acomps,
+                      const RenderOptions& opt, int style, int var, int pat,
+                      const std::string& midPath, const std::string& wavPath) {
+    CaptureSink cap;
+#ifdef ELECTONE_WITH_FLUIDSYNTH
+    FluidSynthSink* fluid = nullptr;
+    if (!wavPath.empty() && !opt.soundfont.empty()) {
+        FluidConfig cfg;
+        cfg.soundfont = opt.soundfont;
+        cfg.renderFile = wavPath;
+        fluid = new FluidSynthSink(cfg);
+        if (fluid->ok()) cap.forward = fluid;
+    }
+#else
+    if (!wavPath.empty()) std::cerr << "--wav requiere compilar con FLUIDSYNTH=1" << std::endl;
+#endif
+
+    forgetChannelsSent(); // Cada archivo arranca con sus programas, no con los del anterior
+    Sequencer seq(&cap);
+    seq.publishDatabases(compileDrumStyles(drums), compileAcompStyles(acomps));
+    seq.setStyle(style);
+    seq.setVar(var);
+    seq.setAcompPattern(pat);
+
+    int steps = drums.count(style) ? drums.at(style).steps : 16;
+    long barTicks = steps * 6;
+    long total = opt.bars * barTicks;
+#ifdef ELECTONE_WITH_FLUIDSYNTH
+    long long tickNs = (long long)(60e9 / (opt.bpm * PPQN));
+#endif
+
+    std::vector<std::vector<int>> chords = opt.chords;
+    if (chords.empty()) chords.push_back({60, 64, 67});
+    std::vector<int> held;
+
+    seq.onStart();
+    for (long t = 0; t < total; t++) {
+        cap.tick = t;
+        if (t % barTicks == 0) {
+            const std::vector<int>& next = chords[(t / barTicks) % chords.size()];
+            for (int n : held) seq.onNoteInput(n, false);
+            for (int n : next) seq.onNoteInput(n, true);
+            held = next;
+        }
+        seq.onClock();
+#ifdef ELECTONE_WITH_FLUIDSYNTH
+        if (cap.forward) fluid->advance(tickNs);
+#endif
+    }
+    cap.tick = total;
+    seq.onStop();
+#ifdef ELECTONE_WITH_FLUIDSYNTH
+    if (cap.forward) fluid->advance(2000000000LL); // Cola de 2 s para los release
+    delete fluid;
+#endif
+
+    return writeSmf(midPath, splitByChannel(cap.events), PPQN, opt.bpm);
+}
+
+int runRender(int argc, char** argv) {
+    RenderOptions opt;
+    std::string chordsText;
+    for (int i = 2; i < argc; i++) {
+        std::string a = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (a == "--help" || a == "-h") { printUsage(); return 0; }
+        if (!hasValue) { std::cerr << "Falta valor para " << a << std::endl; printUsage(); return 1; }
+        std::string v = argv[++i];
+        if (a == "--style") opt.style = std::stoi(v);
+        else if (a == "--var") opt.var = std::stoi(v);
+        else if (a == "--acomp") opt.acomp = std::stoi(v);
+        else if (a == "--bars") opt.bars = std::stoi(v);
+        else if (a == "--bpm") opt.bpm = std::stod(v);
+        else if (a == "--chords") chordsText = v;
+        else if (a == "--out") opt.out = v;
+        else if (a == "--wav") opt.wav = v;
+        else if (a == "--soundfont") opt.soundfont = v;
+        else if (a == "--all") opt.allDir = v;
+        else if (a == "--ritmos") opt.ritmosFile = v;
+        else if (a == "--chords-file") opt.chordsFile = v;
+        else { std::cerr << "Opción desconocida: " << a << std::endl; printUsage(); return 1; }
+    }
+    if (!chordsText.empty()) opt.chords = parseChords(chordsText);
+    if (opt.bars <= 0 || opt.bpm <= 0) { std::cerr << "--bars y --bpm tienen que ser positivos" << std::endl; return 1; }
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::map<int, DrumStyle> drums = loadDrumStyles(opt.ritmosFile);
+    std::map<int, AcompStyle> acomps = loadAcompStyles(opt.chordsFile);
+
+    int rendered = 0;
+    bool ok = true;
+    if (opt.allDir.empty()) {
+        ok = renderOne(drums, acomps, opt, opt.style, opt.var, opt.acomp, opt.out, opt.wav);
+        rendered = 1;
+    } else {
+        for (auto const& [styleId, ds] : drums) {
+            std::vector<int> pats;
+            if (acomps.count(styleId)) for (auto const& [patId, ap] : acomps.at(styleId).patterns) pats.push_back(patId);
+            if (pats.empty()) pats.push_back(0);
+            for (auto const& [varId, dp] : ds.variations) {
+                for (int pat : pats) {
+                    std::string base = opt.allDir + "/s" + std::to_string(styleId) + "_v" + std::to_string(varId) + "_p" + std::to_string(pat);
+                    ok = renderOne(drums, acomps, opt, styleId, varId, pat, base + ".mid",
+                                   opt.soundfont.empty() ? "" : base + ".wav") && ok;
+                    rendered++;
+                }
+            }
+        }
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    std::cout << "Render: " << rendered << " archivo(s) en " << ms << " ms" << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,133 @@
+#include "electone.h"
+#include <yaml-cpp/yaml.h>
+#include <stdexcept>
+
+// --- RUTEO DE CONTROLES ---
+// routing.yaml: puerto -> tipo de mensaje -> número (nota, CC o programa) -> acción.
+// sysex: header común del panel y botón -> acción, con el mismo juego de acciones.
+// Lo que no figura no hace nada; el clock, las notas del acompañamiento y el reenvío a
+// FluidSynth siguen fijos en los callbacks.
+
+struct ActionName {
+    const char* name;
+    RouteAction action;
+};
+static const ActionName ACTIONS[] = {
+    { "forward", RouteAction::Forward },
+    { "cc", RouteAction::ControlOut },
+    { "volume", RouteAction::ControlOut },
+    { "patch", RouteAction::PatchGeneral },
+    { "lead-patch", RouteAction::PatchLead },
+    { "style", RouteAction::Style },
+    { "variation", RouteAction::Var },
+    { "fill", RouteAction::Fill },
+    { "acomp-pattern", RouteAction::AcompPattern },
+    { "chord-mode", RouteAction::ChordMode },
+    { "octave-up", RouteAction::OctaveUp },
+    { "octave-down", RouteAction::OctaveDown },
+    { "master-volume", RouteAction::MasterVolume },
+    { "dump-metrics", RouteAction::DumpMetrics },
+    { "shutdown", RouteAction::Shutdown },
+    { "tempo", RouteAction::Tempo },
+    { "clock-start", RouteAction::ClockStart },
+    { "clock-stop", RouteAction::ClockStop },
+    { "record", RouteAction::Record },
+    { "registration", RouteAction::Registration },
+    { "registration-bank", RouteAction::RegistrationBank },
+    { "registration-store", RouteAction::RegistrationStore },
+};
+
+static const char* const PORT_NAMES[ROUTE_PORTS] = { "maple", "korg" };
+
+// Tipo de mensaje -> (status >> 4) & 7
+static int statusIndex(const std::string& key) {
+    if (key == "note-off") return 0;
+    if (key == "note-on") return 1;
+    if (key == "aftertouch") return 2;
+    if (key == "cc") return 3;
+    if (key == "program") return 4;
+    throw std::runtime_error("tipo de mensaje desconocido '" + key + "'");
+}
+
+static int checkedInt(const YAML::Node& n, int lo, int hi, const std::string& where) {
+    int v = n.as<int>();
+    if (v < lo || v > hi) throw std::runtime_error(where + " fuera de rango (" + std::to_string(v) + ")");
+    return v;
+}
+
+static Route compileRoute(const YAML::Node& node, const std::string& where) {
+    std::string name = node["action"] ? node["action"].as<std::string>() : "";
+    Route r;
+    for (const ActionName& a : ACTIONS) if (name == a.name) r.action = a.action;
+    if (r.action == RouteAction::None) throw std::runtime_error(where + ": acción desconocida '" + name + "'");
+
+    bool needsChannel = r.action == RouteAction::ControlOut || r.action == RouteAction::PatchGeneral || r.action == RouteAction::PatchLead;
+    if (needsChannel) {
+        if (!node["channel"]) throw std::runtime_error(where + ": '" + name + "' necesita channel");
+        r.channel = (unsigned char)checkedInt(node["channel"], 0, 15, where + ": channel");
+    }
+    if (node["value"]) r.value = (signed char)checkedInt(node["value"], 0, 127, where + ": value");
+    if (name == "volume") r.number = 7;
+    else if (name == "cc") {
+        if (!node["number"]) throw std::runtime_error(where + ": 'cc' necesita number");
+        r.number = (unsigned char)checkedInt(node["number"], 0, 127, where + ": number");
+    }
+    return r;
+}
+
+static int compileSysex(const YAML::Node& node, SysexRoutes& sx, const std::string& where) {
+    if (!node["header"]) throw std::runtime_error(where + ": falta header");
+    std::vector<int> header = node["header"].as<std::vector<int>>();
+    if (header.empty() || header.size() > sizeof(sx.header)) throw std::runtime_error(where + ": header de 1 a 16 bytes");
+    for (size_t i = 0; i < header.size(); i++) {
+        if (header[i] < 0 || header[i] > 127) throw std::runtime_error(where + ": byte de header fuera de rango");
+        sx.header[i] = (unsigned char)header[i];
+    }
+    sx.headerLen = (unsigned char)header.size();
+    if (node["log-unknown"]) sx.logUnknown = node["log-unknown"].as<bool>();
+
+    int count = 0;
+    if (node["buttons"]) {
+        for (const auto& entry : node["buttons"]) {
+            std::string bWhere = where + " " + entry.first.as<std::string>();
+            int button = checkedInt(entry.first, 0, 127, bWhere);
+            sx.buttons[button] = compileRoute(entry.second, bWhere);
+            count++;
+        }
+    }
+    return count;
+}
+
+bool loadRouting(const std::string& filename, RoutingTable& table) {
+    table = RoutingTable();
+    try {
+        std::cout << "Cargando Ruteo: " << filename << std::endl;
+        YAML::Node config = YAML::LoadFile(filename);
+        int count = 0;
+        for (int port = 0; port < ROUTE_PORTS; port++) {
+            YAML::Node portNode = config[PORT_NAMES[port]];
+            if (!portNode) continue;
+            for (const auto& typeNode : portNode) {
+                std::string type = typeNode.first.as<std::string>();
+                if (type == "sysex") {
+                    count += compileSysex(typeNode.second, table.sysex[port], std::string(PORT_NAMES[port]) + " sysex");
+                    continue;
+                }
+                int idx = statusIndex(type);
+                for (const auto& entry : typeNode.second) {
+                    std::string where = std::string(PORT_NAMES[port]) + " " + type + " " + entry.first.as<std::string>();
+                    int number = checkedInt(entry.first, 0, 127, where);
+                    table.routes[port][idx][number] = compileRoute(entry.second, where);
+                    count++;
+                }
+            }
+        }
+        std::cout << "  -> " << count << " rutas." << std::endl;
+        return true;
+    } catch (const std::exception& e) {
+        // Nada a medias: sin ruteo válido los controles no hacen nada, pero el motor sigue
+        std::cerr << "Error Ruteo: " << e.what() << std::endl;
+        table = RoutingTable();
+        return false;
+    }
+}
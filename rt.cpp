@@ -0,0 +1,149 @@
+#include "electone.h"
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+#include <malloc.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// --- MODO TIEMPO REAL ---
+// Todo lo caro (syscalls, /proc) pasa una sola vez por hilo o en el volcado; el hilo
+// del clock después no paga nada.
+
+static RealtimeConfig rtConfig;
+
+struct RtThreadInfo {
+    char name[24]; // Copia: el que llama puede pasar un c_str() que después muere
+    pid_t tid;
+    long baseMinFlt, baseMajFlt, baseIvcsw; // Contadores al entrar (getrusage del propio hilo)
+    bool used = false;
+};
+static const int MAX_RT_THREADS = 8;
+static RtThreadInfo rtThreads[MAX_RT_THREADS];
+// Solo al entrar o salir un hilo y en el volcado: nunca en el camino de cada mensaje
+static std::mutex rtThreadsMtx;
+
+// Devuelve el slot cuando el hilo termina: un clock interno que se reinicia no los agota
+struct RtSlotRelease {
+    int slot = -1;
+    ~RtSlotRelease() {
+        if (slot < 0) return;
+        std::lock_guard<std::mutex> lock(rtThreadsMtx);
+        rtThreads[slot].used = false;
+    }
+};
+
+// Toca la pila para que sus páginas ya estén mapeadas (y, con mlockall, fijas)
+static void prefaultStack() {
+    const size_t STACK_PREFAULT = 256 * 1024;
+    unsigned char buf[STACK_PREFAULT];
+    memset(buf, 0, sizeof(buf));
+    asm volatile("" : : "r"(buf) : "memory"); // Que el compilador no borre el memset
+}
+
+bool setupRealtime(const RealtimeConfig& cfg) {
+    rtConfig = cfg;
+    if (!cfg.enabled) return true;
+
+    bool ok = true;
+    // El heap no devuelve memoria ni usa mmap por bloque: lo que se bloqueó queda bloqueado
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        std::cerr << "Tiempo real: mlockall falló (" << strerror(errno) << "), revisar ulimit -l o CAP_IPC_LOCK" << std::endl;
+        ok = false;
+    }
+    prefaultStack();
+    std::cout << "Tiempo real: SCHED_FIFO " << cfg.priority << (cfg.cpu >= 0 ? ", CPU " + std::to_string(cfg.cpu) : "")
+              << (ok ? ", memoria bloqueada" : "") << std::endl;
+    return ok;
+}
+
+void enterRealtimeThread(const char* name) {
+    static thread_local bool entered = false;
+    if (entered) return;
+    entered = true;
+    if (!rtConfig.enabled) return;
+
+    sched_param sp;
+    sp.sched_priority = rtConfig.priority;
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+    if (err != 0) std::cerr << "Tiempo real: SCHED_FIFO en " << name << " falló (" << strerror(err) << ")" << std::endl;
+    if (rtConfig.cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(rtConfig.cpu, &set);
+        err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0) std::cerr << "Tiempo real: afinidad de " << name << " falló (" << strerror(err) << ")" << std::endl;
+    }
+    prefaultStack();
+
+    static thread_local RtSlotRelease held;
+    rusage ru;
+    getrusage(RUSAGE_THREAD, &ru);
+    std::lock_guard<std::mutex> lock(rtThreadsMtx);
+    for (int i = 0; i < MAX_RT_THREADS; i++) {
+        RtThreadInfo& t = rtThreads[i];
+        if (t.used) continue;
+        snprintf(t.name, sizeof(t.name), "%s", name);
+        t.tid = (pid_t)syscall(SYS_gettid);
+        t.baseMinFlt = ru.ru_minflt;
+        t.baseMajFlt = ru.ru_majflt;
+        t.baseIvcsw = ru.ru_nivcsw;
+        t.used = true;
+        held.slot = i;
+        return;
+    }
+}
+
+// /proc/self/task/<tid>/stat: campos 10 (minflt) y 12 (majflt), después del "(comm)"
+static bool readThreadFaults(pid_t tid, long& minFlt, long& majFlt) {
+    std::ifstream f("/proc/self/task/" + std::to_string(tid) + "/stat");
+    std::string line;
+    if (!std::getline(f, line)) return false;
+    size_t close = line.rfind(')');
+    if (close == std::string::npos) return false;
+    std::istringstream is(line.substr(close + 2));
+    std::string field;
+    for (int i = 3; i <= 12 && is >> field; i++) {
+        if (i == 10) minFlt = std::stol(field);
+        if (i == 12) majFlt = std::stol(field);
+    }
+    return true;
+}
+
+static long readStatusField(const std::string& path, const std::string& key) {
+    std::ifstream f(path);
+    std::string line;
+    while (std::getline(f, line)) {
+        if (line.compare(0, key.size(), key) == 0) return std::stol(line.substr(key.size() + 1));
+    }
+    return -1;
+}
+
+void dumpRealtimeStats(std::ostream& os) {
+    if (!rtConfig.enabled) return;
+    os << "Tiempo real: memoria bloqueada " << readStatusField("/proc/self/status", "VmLck") << " kB" << std::endl;
+    RtThreadInfo snap[MAX_RT_THREADS];
+    {
+        std::lock_guard<std::mutex> lock(rtThreadsMtx); // Se copia y /proc se lee afuera
+        std::copy(rtThreads, rtThreads + MAX_RT_THREADS, snap);
+    }
+    for (const RtThreadInfo& t : snap) {
+        if (!t.used) continue;
+        long minFlt = 0, majFlt = 0;
+        if (!readThreadFaults(t.tid, minFlt, majFlt)) {
+            os << "  " << t.name << ": hilo terminado" << std::endl;
+            continue;
+        }
+        long ivcsw = readStatusField("/proc/self/task/" + std::to_string(t.tid) + "/status", "nonvoluntary_ctxt_switches");
+        os << "  " << t.name << " (tid " << t.tid << "): fallos de página " << (minFlt - t.baseMinFlt) << " menores, "
+           << (majFlt - t.baseMajFlt) << " mayores; cambios de contexto involuntarios " << (ivcsw - t.baseIvcsw) << std::endl;
+    }
+}
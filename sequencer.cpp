@@ -1,193 +1,610 @@
 #include "electone.h"
+#include <cstdlib>
+#include <cstring>
 
-Sequencer::Sequencer(RtMidiOut* outPort) : midiOut(outPort) {}
+Sequencer::Sequencer(MidiSink* outSink) : sink(outSink), out(outSink), bank(new StyleBank()) {
+    // Capacidad fija de entrada: los push_back del clock no alocan
+    chordNotes.reserve(128);
+    for (PartVoicing& pv : partVoicing) {
+        pv.voicing.reserve(128);
+        pv.arpCycle.reserve(256);
+        pv.prevVoicing.reserve(128);
+    }
+    for (int ch = 0; ch < 16; ch++)
+        for (int n = 0; n < 128; n++) noteOnTick[ch][n] = noteOffTick[ch][n] = -1;
+}
+
+Sequencer::~Sequencer() {
+    freeRetiredBanks();
+    delete pendingBank.exchange(nullptr);
+    delete bank;
+}
+
+// --- PUBLICACIÓN DE BANCOS (RCU) ---
+void Sequencer::publishDatabases(std::vector<CompiledDrumStyle> drums, std::vector<CompiledAcompStyle> acomps) {
+    freeRetiredBanks();
+    StyleBank* nb = new StyleBank{std::move(drums), std::move(acomps)};
+    // Si había uno publicado que el clock nunca adoptó, nadie más lo ve: se libera acá
+    delete pendingBank.exchange(nb, std::memory_order_acq_rel);
+
+    // Parado no hay compás que esperar
+    if (!isPlaying.load(std::memory_order_acquire) && mtx.try_lock()) {
+        adoptPendingBank();
+        mtx.unlock();
+    }
+}
+
+// Hilo del clock: cambia de banco sin alocar ni liberar
+void Sequencer::adoptPendingBank() {
+    StyleBank* nb = pendingBank.exchange(nullptr, std::memory_order_acq_rel);
+    if (!nb) return;
+    StyleBank* old = bank;
+    bank = nb;
+    voicingDirty = true;
+    if (!retiredBanks.push(old)) {
+        // Nadie publicó en 8 recargas: preferimos perder memoria antes que liberar en el clock
+        std::cerr << "Aviso: banco retirado sin liberar" << std::endl;
+    }
+}
+
+void Sequencer::freeRetiredBanks() {
+    StyleBank* old;
+    while (retiredBanks.pop(old)) delete old;
+}
+
+// Devuelve el patrón id de la tabla, o nullptr si no existe
+static inline const CompiledPattern* patternAt(const std::vector<CompiledPattern>& v, int id) {
+    if (id < 0 || id >= (int)v.size() || v[id].steps == 0) return nullptr;
+    return &v[id];
+}
 
-void Sequencer::setDrumDatabase(std::map<int, DrumStyle> db) { drumDB = db; }
-void Sequencer::setAcompDatabase(std::map<int, AcompStyle> db) { acompDB = db; }
+const CompiledAcompPattern* Sequencer::currentAcomp() const {
+    if (currentStyle < 0 || currentStyle >= (int)bank->acomps.size()) return nullptr;
+    const CompiledAcompStyle& as = bank->acomps[currentStyle];
+    if (currentAcompPat < 0 || currentAcompPat >= (int)as.patterns.size()) return nullptr;
+    const CompiledAcompPattern& ap = as.patterns[currentAcompPat];
+    return ap.valid ? &ap : nullptr;
+}
+
+// --- COLA DE CONTROL ---
+void Sequencer::postCommand(ControlCmd::Type type, int value) {
+    if (!controlQueue.push({type, value})) {
+        queueDropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    atomicMax(queueHighWater, (unsigned)controlQueue.size());
+    drainIfStopped();
+}
+
+void Sequencer::recallRegistration(const CompiledRegistration& reg) {
+    if (!pendingRegs.push(reg)) {
+        queueDropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    drainIfStopped();
+}
+
+// Sin clock corriendo nadie drena: lo hacemos acá si el mutex está libre (sin esperar).
+// Si lo tiene otro (onStop, un clock suelto), ese vuelve a llamar acá al soltarlo: lo que
+// se encoló mientras tanto no queda varado hasta el próximo comando.
+void Sequencer::drainIfStopped() {
+    for (;;) {
+        std::atomic_thread_fence(std::memory_order_seq_cst); // El push de otro hilo contra nuestro unlock
+        if (isPlaying.load(std::memory_order_acquire)) return;
+        if (controlQueue.size() == 0 && pendingRegs.size() == 0) return;
+        if (!mtx.try_lock()) return;
+        drainCommands();
+        applyPendingRegistration();
+        out.flush();
+        publishPanel();
+        mtx.unlock();
+    }
+}
+
+// Hilo del clock: solo la diferencia con lo que ya suena, en el buffer del paso
+void Sequencer::applyPendingRegistration() {
+    CompiledRegistration reg;
+    bool any = false;
+    while (pendingRegs.pop(reg)) any = true;
+    if (!any) return;
+
+    bool acompChanged = false;
+    if (reg.style >= 0 && reg.style != currentStyle) { currentStyle = reg.style; acompChanged = true; }
+    if (reg.acompPattern >= 0 && reg.acompPattern != currentAcompPat) { currentAcompPat = reg.acompPattern; acompChanged = true; }
+    if (reg.var >= 0) currentVar = reg.var;
+    if (reg.setOctave && reg.octave != octaveShift) {
+        octaveShift = reg.octave;
+        voicingDirty = true;
+    }
+    if (acompChanged) {
+        voicingDirty = true;
+        sendAcompPrograms();
+    }
+    for (int ch = 0; ch < 16; ch++) addChannelDelta(out, ch, reg.channels[ch]);
+}
+
+void Sequencer::drainCommands() {
+    ControlCmd cmd;
+    while (controlQueue.pop(cmd)) applyCommand(cmd);
+}
+
+void Sequencer::applyCommand(const ControlCmd& cmd) {
+    switch (cmd.type) {
+    case ControlCmd::NoteOn:
+        if (heldNotes.test(cmd.value)) break; // Repetido: el acorde no cambia
+        heldNotes.set(cmd.value);
+        updateChord();
+        break;
+    case ControlCmd::NoteOff:
+        if (!heldNotes.test(cmd.value)) break;
+        heldNotes.reset(cmd.value);
+        updateChord();
+        break;
+    case ControlCmd::ChordMode:
+        chordMode = cmd.value ? ChordMode::SingleFinger : ChordMode::Fingered;
+        updateChord();
+        break;
+    case ControlCmd::Style:
+        currentStyle = cmd.value;
+        voicingDirty = true;
+        sendAcompPrograms();
+        break;
+    case ControlCmd::Var:
+        currentVar = cmd.value;
+        break;
+    case ControlCmd::Fill:
+        currentFill = cmd.value;
+        break;
+    case ControlCmd::AcompPattern:
+        currentAcompPat = cmd.value;
+        voicingDirty = true;
+        sendAcompPrograms();
+        break;
+    case ControlCmd::Octave:
+        octaveShift += cmd.value;
+        if (octaveShift > 3) octaveShift = 3;
+        if (octaveShift < -3) octaveShift = -3;
+        voicingDirty = true;
+        break;
+    }
+}
+
+OutputStats Sequencer::outputStats() const {
+    return { out.messageCount(), out.sendCount(), maxStepAllocs.load(std::memory_order_relaxed) };
+}
+
+ControlStats Sequencer::controlStats() const {
+    return { queueHighWater.load(std::memory_order_relaxed), queueDropped.load(std::memory_order_relaxed) };
+}
 
 // --- ENTRADA DE NOTAS ---
 void Sequencer::onNoteInput(int note, bool on) {
-    std::lock_guard<std::mutex> lock(mtx); // BLOQUEO
-    if (on) {
-        if (std::find(heldNotes.begin(), heldNotes.end(), note) == heldNotes.end()) {
-            heldNotes.push_back(note);
-            std::sort(heldNotes.begin(), heldNotes.end());
-        }
-    } else {
-        auto it = std::remove(heldNotes.begin(), heldNotes.end(), note);
-        heldNotes.erase(it, heldNotes.end());
+    postCommand(on ? ControlCmd::NoteOn : ControlCmd::NoteOff, note);
+}
+
+// Solo corre cuando cambia lo tocado: el paso lee chord/chordNotes ya resueltos
+void Sequencer::updateChord() {
+    voicingDirty = true;
+    chordNotes.clear();
+    if (heldNotes.empty()) return; // Se suelta todo: silencio, pero el último acorde queda para mostrar
+
+    if (chordMode == ChordMode::Fingered) {
+        unsigned mask = 0;
+        heldNotes.forEach([&](int note) {
+            mask |= 1u << (note % 12);
+            chordNotes.push_back(note); // chord/arp tocan lo que está apretado, como siempre
+        });
+        ChordInfo c = recognizeChord(mask, heldNotes.lowest() % 12);
+        if (c.type != CHORD_NONE) chord = c; // Si no se reconoce, los grados siguen el acorde anterior
+        return;
+    }
+
+    // Single finger: el acorde se arma desde la tecla más aguda (la raíz)
+    chord = singleFingerChord(heldNotes);
+    const ChordTypeDef& def = chordTypeDef(chord.type);
+    int root = heldNotes.highest();
+    static const int CHORD_DEGREES[] = { 1, 3, 5, 7 };
+    for (int d : CHORD_DEGREES) {
+        if (def.degree[d] < 0) continue;
+        int note = root + def.degree[d];
+        if (note <= 127) chordNotes.push_back(note);
     }
 }
 
 // --- CLOCK ---
 void Sequencer::onClock() {
-    std::lock_guard<std::mutex> lock(mtx); // BLOQUEO CRÍTICO
-    if (!isPlaying) return;
+    std::unique_lock<std::mutex> lock(mtx); // BLOQUEO CRÍTICO (sin contención: los controles solo encolan)
+    long long t0 = monoNowNs();
+    pll.onTick(t0); // Período y fase filtrados: el lookahead agenda sobre la grilla predicha
+
+    drainCommands();
+    if (!isPlaying) {
+        applyPendingRegistration();
+        out.flush();
+        publishPanel();
+        publishClock();
+        lock.unlock();
+        drainIfStopped();
+        return;
+    }
 
     if (tickCounter % 6 == 0) {
-        // Apagar notas
-        for (int n : lastDrumNotes) sendNote(CHAN_OUT_DRUMS, n, 0);
-        lastDrumNotes.clear();
-        for (int n : lastAcompNotes) sendNote(CHAN_OUT_ACOMP, n, 0);
-        lastAcompNotes.clear();
+        unsigned long allocsBefore = heapAllocCount();
+
+        // Si el paso actual no se agendó antes (arranque, o sin lookahead), va ahora
+        if (nextStepTick <= tickCounter) {
+            runStep(tickCounter, 0);
+            nextStepTick = tickCounter + 6;
+        }
+        // Con lookahead calculamos el próximo y lo agendamos para cuando llegue su tick;
+        // solo con el PLL enganchado, si no la grilla predicha no vale
+        if (lookahead && pll.locked()) {
+            long long delay = pll.predict(nextStepTick - tickCounter) - monoNowNs();
+            runStep(nextStepTick, delay > 0 ? delay : 0);
+            nextStepTick += 6;
+        }
 
-        // Lógica
-        if (drumDB.count(currentStyle)) {
-            DrumStyle& ds = drumDB[currentStyle];
+        unsigned long stepAllocs = heapAllocCount() - allocsBefore;
+        if (stepAllocs > maxStepAllocs.load(std::memory_order_relaxed)) maxStepAllocs.store(stepAllocs, std::memory_order_relaxed);
+    }
+    out.flush();
 
-            if (tickCounter > 24000) tickCounter = 0;
-            stepIndex = (tickCounter / 6) % ds.steps;
+    // Baldes de la rueda: sin lookahead, solo el de este tick; con lookahead, todo lo ya
+    // calculado (hasta el paso agendado) sale ahora con el timestamp de su tick
+    long horizon = (lookahead && pll.locked()) ? nextStepTick - 1 : tickCounter;
+    while (firedTick < horizon) {
+        firedTick++;
+        fireTick(firedTick);
+        long long delay = (firedTick == tickCounter) ? 0
+                        : pll.predict(firedTick - tickCounter) - monoNowNs();
+        out.flush(delay > 0 ? delay : 0);
+    }
+    tickCounter++;
+    publishPanel();
+    publishClock();
+    metrics.onClockTime.record(monoNowNs() - t0);
+}
 
-            playDrumStep(ds);
+// Calcula el paso que cae en 'tick' y agenda sus notas en la rueda; los program change
+// que haya pendientes salen ya (con delayNs de anticipación si hay lookahead)
+void Sequencer::runStep(long tick, long long delayNs) {
+    stepTick = tick;
 
-            if (acompDB.count(currentStyle)) {
-                playAcompStep(acompDB[currentStyle]);
-            }
+    // Un banco recargado o una registración entran recién al empezar el compás
+    if (pendingBank.load(std::memory_order_relaxed) || pendingRegs.size() > 0) {
+        if ((stepTick / 6) % stepsPerBar() == 0) {
+            adoptPendingBank();
+            applyPendingRegistration();
         }
     }
-    tickCounter++;
+
+    // Lógica
+    if (currentStyle >= 0 && currentStyle < (int)bank->drums.size() && bank->drums[currentStyle].valid) {
+        const CompiledDrumStyle& ds = bank->drums[currentStyle];
+        stepIndex = (stepTick / 6) % ds.steps;
+        int offset = ((stepTick / 6) & 1) ? ds.swing : 0; // Swing: las semis impares caen más tarde
+
+        playDrumStep(ds, offset);
+
+        if (const CompiledAcompPattern* ap = currentAcomp()) playAcompStep(*ap, offset, ds.humanize);
+    }
+
+    out.flush(delayNs);
+}
+
+bool Sequencer::setLookahead(bool enabled) {
+    std::lock_guard<std::mutex> lock(mtx);
+    lookahead = enabled && sink && sink->canSchedule();
+    return lookahead;
 }
 
 // --- LOGICA INTERNA (Privada, sin lock para evitar deadlock) ---
-void Sequencer::playDrumStep(const DrumStyle& ds) {
-    bool notesPlayed = false;
+void Sequencer::playDrumStep(const CompiledDrumStyle& ds, int offset) {
+    const CompiledPattern* target = nullptr;
+    int step = stepIndex;
+
     if (stepIndex == 0 && pendingResolution > 0) {
-        if (ds.resolution.size() > 0) {
-            for (auto const& [note, vel] : ds.resolution) {
-                sendNote(CHAN_OUT_DRUMS, note, vel);
-                lastDrumNotes.push_back(note);
-            }
-            notesPlayed = true;
-        }
+        target = patternAt(ds.resolutions, pendingResolution);
+        step = 0;
         pendingResolution = 0;
     }
-    if (!notesPlayed) {
-        const DrumPattern* target = nullptr;
-        if (currentFill > 0) {
-            if (ds.fills.count(currentFill)) {
-                target = &ds.fills.at(currentFill);
-                if (stepIndex == ds.steps - 1) {
-                    pendingResolution = currentFill;
-                    currentFill = 0;
-                }
-            } else { if (ds.variations.count(currentVar)) target = &ds.variations.at(currentVar); }
-        } else { if (ds.variations.count(currentVar)) target = &ds.variations.at(currentVar); }
-
+    if (!target) {
+        step = stepIndex;
+        if (currentFill > 0) target = patternAt(ds.fills, currentFill);
         if (target) {
-            for (auto const& [note, steps] : target->tracks) {
-                if (stepIndex < (int)steps.size() && steps[stepIndex] > 0) {
-                    int vel = (steps[stepIndex] == 1) ? 100 : steps[stepIndex];
-                    sendNote(CHAN_OUT_DRUMS, note, vel);
-                    lastDrumNotes.push_back(note);
-                }
+            if (stepIndex == ds.steps - 1) {
+                pendingResolution = currentFill;
+                currentFill = 0;
             }
+        } else {
+            target = patternAt(ds.variations, currentVar);
         }
     }
+    if (!target) return;
+
+    // Un solo acceso indexado: los eventos del paso ya están empaquetados
+    const StepEvent* ev = target->events.data() + target->offsets[step];
+    const StepEvent* end = target->events.data() + target->offsets[step + 1];
+    for (; ev != end; ++ev) scheduleNote(CHAN_OUT_DRUMS, ev->note, ev->velocity, ev->gate, offset, ds.humanize);
 }
 
-void Sequencer::playAcompStep(const AcompStyle& as) {
-    if (as.patterns.count(currentAcompPat) == 0) return;
-    if (heldNotes.empty()) return;
+// --- VOICING ---
+static inline unsigned char clampNote(int n) { return (unsigned char)(n < 0 ? 0 : (n > 127 ? 127 : n)); }
+
+// Entre todas las inversiones (y la misma una octava arriba/abajo) se queda con la que menos
+// mueve las voces respecto del voicing anterior. Trabaja sin octaveShift: el cambio de octava
+// pedido por el usuario se respeta siempre.
+void Sequencer::voiceLead(int* notes, int count, const std::vector<int>& prevVoicing) {
+    const int MAX_VOICES = 16;
+    if (prevVoicing.empty() || count > MAX_VOICES) return;
 
-    const AcompPattern& ap = as.patterns.at(currentAcompPat);
-    int currentStep = (tickCounter / 6) % ap.steps;
-    if (currentStep >= (int)ap.pattern.size()) return;
+    int prevSum = 0;
+    for (int n : prevVoicing) prevSum += n;
+    bool sameSize = (int)prevVoicing.size() == count;
 
-    int val = ap.pattern[currentStep];
-    if (val == 0) return;
+    int best[MAX_VOICES], cand[MAX_VOICES];
+    long bestCost = -1;
+    static const int SHIFTS[] = { 0, -12, 12 };
+    for (int inv = 0; inv < count; inv++) {
+        for (int shift : SHIFTS) {
+            // Inversión inv: las inv notas más graves suben una octava
+            for (int i = 0; i < count; i++) cand[i] = notes[(i + inv) % count] + (i + inv >= count ? 12 : 0) + shift;
+            // Con acordes de más de una octava la inversión no queda ordenada: se miran todas
+            int lo = cand[0], hi = cand[0];
+            for (int i = 1; i < count; i++) { lo = std::min(lo, cand[i]); hi = std::max(hi, cand[i]); }
+            if (lo < 0 || hi > 127) continue;
 
+            long cost = 0;
+            if (sameSize) {
+                for (int i = 0; i < count; i++) cost += std::abs(cand[i] - prevVoicing[i]);
+            } else {
+                int sum = 0;
+                for (int i = 0; i < count; i++) sum += cand[i];
+                cost = std::abs(sum * (int)prevVoicing.size() - prevSum * count); // Distancia entre centros
+            }
+            if (bestCost < 0 || cost < bestCost) {
+                bestCost = cost;
+                std::copy(cand, cand + count, best);
+            }
+        }
+    }
+    if (bestCost >= 0) std::copy(best, best + count, notes);
+}
+
+void Sequencer::buildVoicing(const CompiledAcompPart& part, PartVoicing& pv) {
+    pv.voicing.clear();
+    pv.arpCycle.clear();
     int shiftAmount = octaveShift * 12;
 
-    if (ap.mode == "chord") {
-        for (int note : heldNotes) {
-            int finalNote = note + shiftAmount;
-            if (finalNote < 0) finalNote = 0; if (finalNote > 127) finalNote = 127;
-            sendNote(CHAN_OUT_ACOMP, finalNote, ap.velocity);
-            lastAcompNotes.push_back(finalNote);
+    if (part.mode == AcompMode::Degree) {
+        for (int d = 0; d < 10; d++) pv.degreeNotes[d] = 0;
+        if (chord.type == CHORD_NONE) return;
+        const ChordTypeDef& def = chordTypeDef(chord.type);
+        for (int d = 1; d < 10; d++) {
+            int interval = def.degree[d];
+            if (interval < 0) interval = 12; // El acorde no tiene ese grado (7 en una tríada): octava
+            pv.degreeNotes[d] = clampNote(part.baseNote + chord.root + interval + shiftAmount);
         }
+        return;
     }
-    else {
-        int idxRequest = val - 1;
-        int numNotes = heldNotes.size();
-        int noteToPlay = -1;
-        if (ap.mode == "arp-once") { noteToPlay = heldNotes[idxRequest % numNotes]; }
-        else if (ap.mode == "arp-loop") {
-            if (numNotes == 1) noteToPlay = heldNotes[0];
-            else {
-                int cycleLen = (numNotes * 2) - 2;
-                int posInCycle = idxRequest % cycleLen;
-                noteToPlay = (posInCycle < numNotes) ? heldNotes[posInCycle] : heldNotes[cycleLen - posInCycle];
-            }
+
+    int count = (int)chordNotes.size();
+    int notes[128];
+    for (int i = 0; i < count; i++) notes[i] = chordNotes[i];
+    if (part.voiceLead) {
+        voiceLead(notes, count, pv.prevVoicing);
+        pv.prevVoicing.assign(notes, notes + count);
+    }
+    for (int i = 0; i < count; i++) pv.voicing.push_back(clampNote(notes[i] + shiftAmount));
+
+    // arp-loop: 1-2-3-2 desplegado una vez, el paso solo indexa
+    if (part.mode == AcompMode::ArpLoop) {
+        if (count == 1) pv.arpCycle.push_back(pv.voicing[0]);
+        else {
+            for (int i = 0; i < count; i++) pv.arpCycle.push_back(pv.voicing[i]);
+            for (int i = count - 2; i > 0; i--) pv.arpCycle.push_back(pv.voicing[i]);
+        }
+    }
+}
+
+void Sequencer::playAcompStep(const CompiledAcompPattern& ap, int offset, int humanize) {
+    if (chordNotes.empty()) return;
+
+    // Un solo flujo para todas las partes: el paso es un rango de eventos ya mezclados
+    int currentStep = (stepTick / 6) % ap.steps;
+    const AcompEvent* ev = ap.events.data() + ap.offsets[currentStep];
+    const AcompEvent* end = ap.events.data() + ap.offsets[currentStep + 1];
+    if (ev == end) return;
+
+    if (voicingDirty) {
+        for (size_t p = 0; p < ap.parts.size(); p++) buildVoicing(ap.parts[p], partVoicing[p]);
+        voicingDirty = false;
+    }
+
+    for (; ev != end; ++ev) {
+        const CompiledAcompPart& part = ap.parts[ev->part];
+        const PartVoicing& pv = partVoicing[ev->part];
+        if (part.mode == AcompMode::Degree) {
+            if (chord.type == CHORD_NONE) continue;
+            scheduleNote(part.channel, pv.degreeNotes[ev->value], part.velocity, ev->gate, offset, humanize);
+        }
+        else if (part.mode == AcompMode::Chord) {
+            for (unsigned char note : pv.voicing) scheduleNote(part.channel, note, part.velocity, ev->gate, offset, humanize);
         }
-        if (noteToPlay != -1) {
-            int finalNote = noteToPlay + shiftAmount;
-            if (finalNote < 0) finalNote = 0; if (finalNote > 127) finalNote = 127;
-            sendNote(CHAN_OUT_ACOMP, finalNote, ap.velocity);
-            lastAcompNotes.push_back(finalNote);
+        else {
+            int idxRequest = ev->value - 1;
+            unsigned char note = (part.mode == AcompMode::ArpOnce) ? pv.voicing[idxRequest % pv.voicing.size()]
+                                                                   : pv.arpCycle[idxRequest % pv.arpCycle.size()];
+            scheduleNote(part.channel, note, part.velocity, ev->gate, offset, humanize);
         }
     }
 }
 
+// --- RUEDA DE TIEMPOS ---
+// El note on y su note off se agendan juntos (o ninguno: sin lugar en el pool la nota no
+// suena, pero nunca queda colgada)
+void Sequencer::scheduleNote(int channel, int note, int velocity, int gate, int offset, int humanize) {
+    if (wheel.available() < 2) return;
+    if (humanize > 0) {
+        rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+        velocity += (int)(rng % (2 * humanize + 1)) - humanize;
+        velocity = velocity < 1 ? 1 : (velocity > 127 ? 127 : velocity);
+    }
+    long on = stepTick + offset;
+    wheel.schedule(on, { (unsigned char)channel, (unsigned char)note, (unsigned char)velocity, (unsigned short)gate, 0 });
+    wheel.schedule(on + gate, { (unsigned char)channel, (unsigned char)note, 0, 0, 0 });
+}
+
+void Sequencer::fireTick(long tick) {
+    wheel.fire(tick, [&](const WheelEvent& ev) {
+        long& offTick = noteOffTick[ev.channel][ev.note];
+        if (ev.velocity == 0) {
+            // Un ataque posterior (re-ataque o ligadura más larga) corrió el note off
+            if (offTick == tick) sendNote(ev.channel, ev.note, 0);
+            return;
+        }
+        long& onTick = noteOnTick[ev.channel][ev.note];
+        bool on = sounding.channel[ev.channel].test(ev.note);
+        if (on && onTick == tick) {
+            // Dos ataques en el mismo tick: uno solo, con el gate más largo
+            if (tick + ev.gate > offTick) offTick = tick + ev.gate;
+            return;
+        }
+        if (on) sendNote(ev.channel, ev.note, 0); // Todavía sonaba: re-ataque
+        sendNote(ev.channel, ev.note, ev.velocity);
+        onTick = tick;
+        offTick = tick + ev.gate;
+    });
+}
+
 // --- CONTROLES Y TRANSPORTE (CON LOCK) ---
 
 void Sequencer::onStart() {
     std::lock_guard<std::mutex> lock(mtx); // BLOQUEO
-    isPlaying = true; tickCounter = 0; stepIndex = 0; pendingResolution = 0;
-    // Panic soft
-    sendProgramChange(CHAN_OUT_DRUMS, 123);
-    sendProgramChange(CHAN_OUT_ACOMP, 123);
+    adoptPendingBank();
+    drainCommands();
+    isPlaying = true; tickCounter = 0; nextStepTick = 0; stepIndex = 0; pendingResolution = 0; firedTick = -1;
+    // Panic soft: lo que quedó anotado se apaga exacto, y All Notes Off por si otro
+    // programa dejó algo colgado en nuestros canales (con lookahead ya lo mandó panic)
+    panic();
+    if (!lookahead) allNotesOff();
+    out.flush();
+    publishPanel();
 }
 
 void Sequencer::onStop() {
-    std::lock_guard<std::mutex> lock(mtx); // BLOQUEO
+    std::unique_lock<std::mutex> lock(mtx); // BLOQUEO
     isPlaying = false;
+    drainCommands();
     panic();
+    out.flush();
+    publishPanel();
+    lock.unlock();
+    drainIfStopped();
+#ifdef ELECTONE_COUNT_ALLOCS
+    std::cout << "Alocaciones por paso (peor caso): " << maxStepAllocs.load() << std::endl;
+#endif
 }
 
-void Sequencer::setStyle(int style) {
-    std::lock_guard<std::mutex> lock(mtx); // BLOQUEO
-    currentStyle = style;
-    if (acompDB.count(currentStyle) && acompDB[currentStyle].patterns.count(currentAcompPat)) {
-        sendProgramChange(CHAN_OUT_ACOMP, acompDB[currentStyle].patterns[currentAcompPat].program);
-    }
-}
+void Sequencer::setStyle(int style) { postCommand(ControlCmd::Style, style); }
+void Sequencer::setVar(int var) { postCommand(ControlCmd::Var, var); }
+void Sequencer::setFill(int fill) { postCommand(ControlCmd::Fill, fill); }
+void Sequencer::setAcompPattern(int pat) { postCommand(ControlCmd::AcompPattern, pat); }
+void Sequencer::changeOctave(int direction) { postCommand(ControlCmd::Octave, direction); }
+void Sequencer::setChordMode(int mode) { postCommand(ControlCmd::ChordMode, mode); }
 
-void Sequencer::setVar(int var) { std::lock_guard<std::mutex> lock(mtx); currentVar = var; }
-void Sequencer::setFill(int fill) { std::lock_guard<std::mutex> lock(mtx); currentFill = fill; }
 
-void Sequencer::setAcompPattern(int pat) {
-    std::lock_guard<std::mutex> lock(mtx); // BLOQUEO
-    currentAcompPat = pat;
-    if (acompDB.count(currentStyle) && acompDB[currentStyle].patterns.count(currentAcompPat)) {
-        sendProgramChange(CHAN_OUT_ACOMP, acompDB[currentStyle].patterns[currentAcompPat].program);
+// --- HELPERS (Privados) ---
+// Todo note on/off pasa por el ledger: un note on repetido no se manda (el sinte no apila
+// dos voces con un solo note off) y un note off de algo que no suena tampoco
+void Sequencer::sendNote(int channel, int note, int velocity) {
+    NoteSet& on = sounding.channel[channel];
+    if (velocity > 0) {
+        if (on.test(note)) return;
+        on.set(note);
+        outChannels |= 1 << channel;
+    } else {
+        if (!on.test(note)) return;
+        on.reset(note);
     }
+    out.add((velocity > 0 ? 0x90 : 0x80) + channel, note, velocity);
 }
 
-void Sequencer::changeOctave(int direction) {
-    std::lock_guard<std::mutex> lock(mtx); // BLOQUEO
-    octaveShift += direction;
-    if (octaveShift > 3) octaveShift = 3;
-    if (octaveShift < -3) octaveShift = -3;
+// Un note off por cada nota prendida en el canal, de una pasada
+void Sequencer::releaseChannel(int channel) {
+    NoteSet& on = sounding.channel[channel];
+    on.forEach([&](int note) { out.add(0x80 + channel, note, 0); });
+    on.clear();
 }
 
+// Cada parte del patrón elegido con su programa, en su canal. Pasa por el espejo de lo
+// mandado: Style seguido de AcompPattern (o un recall) no repite un programa que ya está.
+void Sequencer::sendAcompPrograms() {
+    if (const CompiledAcompPattern* ap = currentAcomp())
+        for (const CompiledAcompPart& part : ap->parts) {
+            ChannelTarget t;
+            t.program = (signed char)(part.program & 0x7F);
+            addChannelDelta(out, part.channel, t);
+        }
+}
 
-// --- HELPERS (Privados) ---
-void Sequencer::sendNote(int channel, int note, int velocity) {
-    std::vector<unsigned char> message;
-    message.push_back((velocity > 0 ? 0x90 : 0x80) + channel);
-    message.push_back(note);
-    message.push_back(velocity);
-    midiOut->sendMessage(&message);
+// CC 123 en todos los canales donde tocamos alguna vez
+void Sequencer::allNotesOff() {
+    for (int ch = 0; ch < 16; ch++)
+        if (outChannels & (1 << ch)) out.add(0xB0 + ch, 123, 0);
 }
 
-void Sequencer::sendProgramChange(int channel, int program) {
-    std::vector<unsigned char> message = { (unsigned char)(0xC0 + channel), (unsigned char)program };
-    midiOut->sendMessage(&message);
+// Instantánea para la pantalla (siempre con mtx tomado: un solo escritor). Si nada
+// cambió no se toca el seqlock y el lector no tiene nada que redibujar.
+void Sequencer::publishPanel() {
+    PanelState st;
+    memset(&st, 0, sizeof(st)); // Relleno en cero: se compara con memcmp
+    st.style = (short)currentStyle;
+    st.var = (short)currentVar;
+    st.fill = (short)currentFill;
+    st.acompPattern = (short)currentAcompPat;
+    st.octave = (short)octaveShift;
+    st.bpm = pll.period() > 0 ? (short)(60e9 / (pll.period() * PPQN) + 0.5) : 0;
+    st.chord = chord;
+    st.playing = isPlaying.load(std::memory_order_relaxed);
+    if (memcmp(&st, &lastPanel, sizeof(st)) == 0) return;
+    lastPanel = st;
+    panel.store(st);
 }
 
 void Sequencer::panic() {
-    for (int n : lastDrumNotes) sendNote(CHAN_OUT_DRUMS, n, 0);
-    for (int n : lastAcompNotes) sendNote(CHAN_OUT_ACOMP, n, 0);
-    lastDrumNotes.clear();
-    lastAcompNotes.clear();
+    // Lo agendado a futuro ya no tiene que sonar. ALSA saca solo los note on pendientes y
+    // deja los note off (SND_SEQ_REMOVE_IGNORE_OFF), así que la cancelación no cuelga nada.
+    // All Notes Off queda como red para salidas que cancelan distinto; onStart no lo repite
+    if (lookahead) {
+        out.flush();
+        sink->cancelScheduled();
+        allNotesOff();
+    }
+    // Sin lookahead, exactamente lo que quedó prendido y nada más
+    for (int ch = 0; ch < 16; ch++) releaseChannel(ch);
+    // Lo que falta disparar de la rueda ya no corresponde
+    wheel.clear();
+    for (int ch = 0; ch < 16; ch++)
+        for (int n = 0; n < 128; n++) noteOnTick[ch][n] = noteOffTick[ch][n] = -1;
+}
+
+int Sequencer::stepsPerBar() const {
+    bool styleOk = currentStyle >= 0 && currentStyle < (int)bank->drums.size() && bank->drums[currentStyle].valid;
+    return styleOk ? bank->drums[currentStyle].steps : 16;
+}
+
+// Tempo y fase para el resto del motor. tickCounter ya es el próximo tick
+void Sequencer::publishClock() {
+    ClockEstimate ce = {};
+    ce.periodNs = pll.period();
+    ce.lastTickNs = pll.predict(0);
+    ce.nextTickNs = pll.predict(1);
+    ce.locked = pll.locked();
+    if (isPlaying && ce.periodNs > 0) {
+        long barTicks = stepsPerBar() * 6;
+        long toBar = (barTicks - tickCounter % barTicks) % barTicks;
+        ce.nextBarNs = pll.predict(1 + toBar);
+    }
+    clockState.store(ce);
 }
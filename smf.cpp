@@ -0,0 +1,72 @@
+#include "electone.h"
+#include <fstream>
+
+// --- STANDARD MIDI FILE ---
+static void putVarLen(std::vector<unsigned char>& out, unsigned long v) {
+    unsigned char tmp[4];
+    int n = 0;
+    do { tmp[n++] = v & 0x7F; v >>= 7; } while (v && n < 4);
+    while (n > 1) out.push_back(tmp[--n] | 0x80);
+    out.push_back(tmp[0]);
+}
+
+static void putBE(std::vector<unsigned char>& out, unsigned long v, int bytes) {
+    for (int i = bytes - 1; i >= 0; i--) out.push_back((v >> (8 * i)) & 0xFF);
+}
+
+static void writeChunk(std::ofstream& f, const char* id, const std::vector<unsigned char>& body) {
+    std::vector<unsigned char> hdr(id, id + 4);
+    putBE(hdr, body.size(), 4);
+    f.write((const char*)hdr.data(), hdr.size());
+    f.write((const char*)body.data(), body.size());
+}
+
+// Formato 0 si hay una sola pista, formato 1 si hay varias (el tempo va en la primera)
+bool writeSmf(const std::string& path, const std::vector<SmfTrack>& tracks, int division, double bpm) {
+    std::ofstream f(path, std::ios::binary);
+    if (!f) {
+        std::cerr << "Error SMF: no se pudo escribir " << path << std::endl;
+        return false;
+    }
+
+    std::vector<unsigned char> hdr;
+    putBE(hdr, tracks.size() > 1 ? 1 : 0, 2);
+    putBE(hdr, tracks.size(), 2);
+    putBE(hdr, division, 2);
+    writeChunk(f, "MThd", hdr);
+
+    for (size_t t = 0; t < tracks.size(); t++) {
+        const SmfTrack& tr = tracks[t];
+        std::vector<unsigned char> body;
+
+        if (!tr.name.empty()) {
+            body.insert(body.end(), {0x00, 0xFF, 0x03});
+            putVarLen(body, tr.name.size());
+            body.insert(body.end(), tr.name.begin(), tr.name.end());
+        }
+        if (t == 0) {
+            unsigned long usPerQuarter = (unsigned long)(60000000.0 / bpm);
+            body.insert(body.end(), {0x00, 0xFF, 0x51, 0x03});
+            putBE(body, usPerQuarter, 3);
+        }
+
+        unsigned long lastTick = 0;
+        for (const SmfEvent& ev : tr.events) {
+            if (ev.data.empty()) continue;
+            unsigned long tick = ev.tick < lastTick ? lastTick : ev.tick;
+            putVarLen(body, tick - lastTick);
+            lastTick = tick;
+            if (ev.data[0] == 0xF0) {
+                // SysEx: F0 <largo> <datos incluyendo F7>
+                body.push_back(0xF0);
+                putVarLen(body, ev.data.size() - 1);
+                body.insert(body.end(), ev.data.begin() + 1, ev.data.end());
+            } else {
+                body.insert(body.end(), ev.data.begin(), ev.data.end());
+            }
+        }
+        body.insert(body.end(), {0x00, 0xFF, 0x2F, 0x00});
+        writeChunk(f, "MTrk", body);
+    }
+    return (bool)f;
+}